@@ -0,0 +1,769 @@
+// Fleet telemetry collector for the washer controllers.
+//
+// Reads the binary telemetry frames of many units at once (one serial port,
+// FIFO or file each, multiplexed with epoll) and batches them into one
+// columnar time-series file. Queries map the file read-only and only touch
+// the blocks and columns they need.
+//
+//     collector record FILE [name=]PORT...   Collect until SIGINT/SIGTERM
+//     collector list FILE                    Machines, samples, dropped frames
+//     collector utilisation FILE [FROM TO]   Share of time with a cycle running
+//     collector aborts FILE [FROM TO]        Completed, aborted and interrupted cycles
+//
+// FROM and TO are Unix seconds. Build with:
+//     g++ -O2 -std=gnu++14 -Wall -Wextra collector/collector.cpp -o collector
+//
+// File layout (little endian, all offsets in bytes):
+//     0       FileHeader
+//     64      MachineEntry[MAX_MACHINES], the per-machine index
+//     65536   Blocks, each BLOCK_SAMPLES samples of one machine in columns
+//             (time, type, code, value 0-3) behind a BlockHeader. The blocks
+//             of a machine form a chain from its MachineEntry.
+#include <cerrno>
+#include <cstddef>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "../telemetry_protocol.h"
+
+// Constants
+const uint32_t FILE_VERSION = 1;
+const int MAX_MACHINES = 1023;             // Index entries (fills the first 64 KiB)
+const int BLOCK_SAMPLES = 512;             // Samples per block
+const int FLUSH_PERIOD_MS = 1000;          // Batched samples are written at least this often
+const int FLUSH_SAMPLES = 128;             // ... or once this many are pending on a machine
+const int READ_BUFFER_SIZE = 4096;         // Bytes read per unit per wakeup
+const int MAX_EPOLL_EVENTS = 64;
+const uint32_t BLOCK_MAGIC = 0x4B4C4257;   // "WBLK"
+
+struct FileHeader {
+    char magic[4];          // "WTSF"
+    uint32_t version;
+    uint32_t blockSamples;
+    uint32_t machineCount;
+    uint64_t fileEnd;       // Next block goes here
+    uint8_t reserved[40];
+};
+
+struct MachineEntry {
+    char name[32];
+    uint64_t firstBlock;    // 0 until the first sample
+    uint64_t lastBlock;     // Block samples are appended to
+    uint64_t samples;
+    uint32_t dropped;       // Frames missing from the sequence numbers
+    uint32_t badFrames;     // Frames failing the length or checksum check
+};
+
+struct BlockHeader {
+    uint32_t magic;
+    uint32_t machine;       // Index entry
+    uint32_t count;         // Samples written
+    uint32_t reserved;
+    int64_t firstMs;        // Time of the first and last sample
+    int64_t lastMs;
+    uint64_t next;          // Next block of the machine, 0 for the last
+    uint8_t reserved2[24];
+};
+
+static_assert(sizeof(FileHeader) == 64, "FileHeader must stay packed");
+static_assert(sizeof(MachineEntry) == 64, "MachineEntry must stay packed");
+static_assert(sizeof(BlockHeader) == 64, "BlockHeader must stay packed");
+
+const uint64_t DIRECTORY_OFFSET = sizeof(FileHeader);
+const uint64_t DATA_OFFSET = DIRECTORY_OFFSET + MAX_MACHINES * sizeof(MachineEntry);
+static_assert(DATA_OFFSET == 65536, "Index must fill the first 64 KiB");
+
+// Columns of a block, after its header
+const uint64_t COLUMN_TIME = sizeof(BlockHeader);                 // int64_t, ms since the epoch
+const uint64_t COLUMN_TYPE = COLUMN_TIME + 8 * BLOCK_SAMPLES;     // uint8_t TelemetryType
+const uint64_t COLUMN_CODE = COLUMN_TYPE + BLOCK_SAMPLES;         // uint8_t code
+const uint64_t COLUMN_VALUES = COLUMN_CODE + BLOCK_SAMPLES;       // int16_t × 4 columns
+const uint64_t BLOCK_SIZE = COLUMN_VALUES + 4 * 2 * BLOCK_SAMPLES;
+
+// One telemetry frame, as received
+struct Sample {
+    int64_t timeMs;
+    uint8_t type;
+    uint8_t code;
+    int16_t values[4];
+};
+
+enum ParseState {
+    PARSE_SYNC,
+    PARSE_LENGTH,
+    PARSE_PAYLOAD,
+    PARSE_CHECKSUM
+};
+
+// A connected controller
+struct Unit {
+    int fd;
+    int machine;                // Index entry
+    bool serial;                // A serial port, commands can be sent back
+    bool textSeen;              // A text line arrived, the unit is in text mode
+    ParseState state;
+    uint8_t length;
+    uint8_t received;
+    uint8_t sum;
+    uint8_t payload[255];
+    bool synced;                // A frame has been seen since the last reboot
+    uint16_t lastSeq;
+    uint32_t lastDeviceMs;
+    int64_t baseMs;             // Host time of the unit's clock zero
+    int64_t lastMs;             // Time of the newest sample
+    uint32_t dropped;
+    uint32_t badFrames;
+    std::vector<Sample> pending;
+};
+
+// Collector state
+int storeFd = -1;
+FileHeader header;
+MachineEntry machines[MAX_MACHINES];
+std::vector<Unit> units;
+
+// Functions
+bool openStore(const char* path);
+int findMachine(const char* name);
+bool writeAt(uint64_t offset, const void* data, size_t size);
+bool appendBlock(int machine, int64_t timeMs);
+bool flushUnit(Unit& unit);
+bool flushAll();
+bool openUnit(const char* arg);
+void sendBinaryMode(int fd, const char* name);
+void checkUnitModes();
+void readUnit(Unit& unit);
+void receiveByte(Unit& unit, uint8_t c);
+void receiveFrame(Unit& unit);
+int64_t hostMs();
+int record(const char* path, int argc, char** argv);
+
+const uint8_t* mapStore(const char* path, size_t& size);
+template<typename F> void forEachSample(const uint8_t* base, size_t size, int machine, int64_t from, int64_t to, F visit);
+int listMachines(const char* path);
+int queryCycles(const char* path, bool aborts, int64_t from, int64_t to);
+
+int64_t hostMs() {
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// ---------------------------------------------------------------------------
+// Store (record side)
+// ---------------------------------------------------------------------------
+
+bool writeAt(uint64_t offset, const void* data, size_t size) {
+    const uint8_t* p = (const uint8_t*)data;
+    while (size > 0) {
+        ssize_t n = pwrite(storeFd, p, size, offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            perror("collector: write");
+            return false;
+        }
+        p += n;
+        offset += n;
+        size -= n;
+    }
+    return true;
+}
+
+// Open an existing store or create an empty one
+bool openStore(const char* path) {
+    storeFd = open(path, O_RDWR | O_CREAT, 0644);
+    if (storeFd < 0) {
+        perror(path);
+        return false;
+    }
+
+    ssize_t n = pread(storeFd, &header, sizeof(header), 0);
+    if (n == 0) {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "WTSF", 4);
+        header.version = FILE_VERSION;
+        header.blockSamples = BLOCK_SAMPLES;
+        header.fileEnd = DATA_OFFSET;
+        memset(machines, 0, sizeof(machines));
+        return writeAt(DIRECTORY_OFFSET, machines, sizeof(machines)) && writeAt(0, &header, sizeof(header));
+    }
+
+    if (n != sizeof(header) || memcmp(header.magic, "WTSF", 4) != 0 ||
+        header.version != FILE_VERSION || header.blockSamples != BLOCK_SAMPLES) {
+        fprintf(stderr, "collector: %s is not a version %u store\n", path, FILE_VERSION);
+        return false;
+    }
+    if (pread(storeFd, machines, sizeof(machines), DIRECTORY_OFFSET) != (ssize_t)sizeof(machines)) {
+        fprintf(stderr, "collector: %s has a truncated index\n", path);
+        return false;
+    }
+    return true;
+}
+
+// Index entry of a machine, added if new (-1 when the index is full)
+int findMachine(const char* name) {
+    for (uint32_t i = 0; i < header.machineCount; i++) {
+        if (strncmp(machines[i].name, name, sizeof(machines[i].name)) == 0) {
+            return i;
+        }
+    }
+    if (header.machineCount >= (uint32_t)MAX_MACHINES) {
+        return -1;
+    }
+    int machine = header.machineCount++;
+    memset(&machines[machine], 0, sizeof(MachineEntry));
+    strncpy(machines[machine].name, name, sizeof(machines[machine].name) - 1);
+    writeAt(DIRECTORY_OFFSET + machine * sizeof(MachineEntry), &machines[machine], sizeof(MachineEntry));
+    writeAt(0, &header, sizeof(header));
+    return machine;
+}
+
+// Start a new block at the end of the file and link it to the machine's chain.
+// The block is written before the links to it, so a crash leaves at worst an
+// unreferenced block.
+bool appendBlock(int machine, int64_t timeMs) {
+    uint64_t offset = header.fileEnd;
+    BlockHeader block;
+    memset(&block, 0, sizeof(block));
+    block.magic = BLOCK_MAGIC;
+    block.machine = machine;
+    block.firstMs = timeMs;
+    block.lastMs = timeMs;
+    if (ftruncate(storeFd, offset + BLOCK_SIZE) != 0 || !writeAt(offset, &block, sizeof(block))) {
+        return false;
+    }
+
+    MachineEntry& m = machines[machine];
+    if (m.lastBlock != 0) {
+        if (!writeAt(m.lastBlock + offsetof(BlockHeader, next), &offset, sizeof(offset))) {
+            return false;
+        }
+    } else {
+        m.firstBlock = offset;
+    }
+    m.lastBlock = offset;
+    header.fileEnd = offset + BLOCK_SIZE;
+    return writeAt(0, &header, sizeof(header));
+}
+
+// Write a unit's batched samples into its machine's last block, column by
+// column, then the block header and index entry
+bool flushUnit(Unit& unit) {
+    MachineEntry& m = machines[unit.machine];
+    m.dropped = unit.dropped;
+    m.badFrames = unit.badFrames;
+    size_t done = 0;
+
+    while (done < unit.pending.size()) {
+        BlockHeader block;
+        if (m.lastBlock != 0 && pread(storeFd, &block, sizeof(block), m.lastBlock) != (ssize_t)sizeof(block)) {
+            return false;
+        }
+        if (m.lastBlock == 0 || block.count == (uint32_t)BLOCK_SAMPLES) {
+            if (!appendBlock(unit.machine, unit.pending[done].timeMs) ||
+                pread(storeFd, &block, sizeof(block), m.lastBlock) != (ssize_t)sizeof(block)) {
+                return false;
+            }
+        }
+
+        int n = (int)(unit.pending.size() - done);
+        if (n > BLOCK_SAMPLES - (int)block.count) {
+            n = BLOCK_SAMPLES - block.count;
+        }
+        int64_t times[BLOCK_SAMPLES];
+        uint8_t types[BLOCK_SAMPLES];
+        uint8_t codes[BLOCK_SAMPLES];
+        int16_t values[4][BLOCK_SAMPLES];
+        for (int i = 0; i < n; i++) {
+            const Sample& s = unit.pending[done + i];
+            times[i] = s.timeMs;
+            types[i] = s.type;
+            codes[i] = s.code;
+            for (int v = 0; v < 4; v++) {
+                values[v][i] = s.values[v];
+            }
+        }
+
+        uint64_t at = m.lastBlock;
+        uint32_t first = block.count;
+        bool ok = writeAt(at + COLUMN_TIME + 8 * first, times, 8 * n) &&
+                  writeAt(at + COLUMN_TYPE + first, types, n) &&
+                  writeAt(at + COLUMN_CODE + first, codes, n);
+        for (int v = 0; v < 4 && ok; v++) {
+            ok = writeAt(at + COLUMN_VALUES + (2 * v * BLOCK_SAMPLES) + 2 * first, values[v], 2 * n);
+        }
+        if (first == 0) {
+            block.firstMs = times[0];
+        }
+        block.lastMs = times[n - 1];
+        block.count += n;
+        if (!ok || !writeAt(at, &block, sizeof(block))) {
+            return false;
+        }
+        m.samples += n;
+        done += n;
+    }
+
+    unit.pending.clear();
+    return writeAt(DIRECTORY_OFFSET + unit.machine * sizeof(MachineEntry), &m, sizeof(m));
+}
+
+bool flushAll() {
+    bool ok = true;
+    for (Unit& unit : units) {
+        ok = flushUnit(unit) && ok;
+    }
+    return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Units
+// ---------------------------------------------------------------------------
+
+// Open a unit's port as "[name=]path". A serial port is set to raw
+// 115200 baud and sent CMD_SET_MODE so the unit switches to binary frames
+// (again whenever it falls back to text, see checkUnitModes()); FIFOs and
+// files are read as they are.
+bool openUnit(const char* arg) {
+    const char* eq = strchr(arg, '=');
+    const char* path = eq ? eq + 1 : arg;
+    char name[32];
+    if (eq) {
+        snprintf(name, sizeof(name), "%.*s", (int)(eq - arg), arg);
+    } else {
+        const char* slash = strrchr(path, '/');
+        snprintf(name, sizeof(name), "%s", slash ? slash + 1 : path);
+    }
+
+    struct stat st;
+    bool device = stat(path, &st) == 0 && S_ISCHR(st.st_mode);
+    int fd = open(path, (device ? O_RDWR : O_RDONLY) | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0) {
+        perror(path);
+        return false;
+    }
+
+    bool serial = isatty(fd);
+    if (serial) {
+        termios tio;
+        tcgetattr(fd, &tio);
+        cfmakeraw(&tio);
+        cfsetispeed(&tio, B115200);
+        cfsetospeed(&tio, B115200);
+        tcsetattr(fd, TCSANOW, &tio);
+        sendBinaryMode(fd, path);
+    }
+
+    int machine = findMachine(name);
+    if (machine < 0) {
+        fprintf(stderr, "collector: index full, %s not recorded\n", name);
+        close(fd);
+        return false;
+    }
+    for (const Unit& unit : units) {
+        if (unit.machine == machine) {
+            fprintf(stderr, "collector: %s given twice\n", name);
+            close(fd);
+            return false;
+        }
+    }
+
+    Unit unit = Unit();
+    unit.fd = fd;
+    unit.machine = machine;
+    unit.serial = serial;
+    unit.state = PARSE_SYNC;
+    unit.dropped = machines[machine].dropped;
+    unit.badFrames = machines[machine].badFrames;
+    BlockHeader last;
+    if (machines[machine].lastBlock != 0 &&
+        pread(storeFd, &last, sizeof(last), machines[machine].lastBlock) == (ssize_t)sizeof(last)) {
+        unit.lastMs = last.lastMs;
+    }
+    units.push_back(unit);
+    return true;
+}
+
+// Ask a unit for binary frames
+void sendBinaryMode(int fd, const char* name) {
+    uint8_t frame[] = {TELEMETRY_SYNC, 2, CMD_SET_MODE, 1, 0};
+    frame[4] = (uint8_t)(0x100 - (TELEMETRY_SYNC + 2 + CMD_SET_MODE + 1));
+    if (write(fd, frame, sizeof(frame)) != (ssize_t)sizeof(frame)) {
+        fprintf(stderr, "collector: %s: cannot switch to binary mode\n", name);
+    }
+}
+
+// A unit that lost its mode in a power cycle boots sending text lines:
+// switch it back, at most once per flush period (the first lines of a
+// boot follow in the same burst)
+void checkUnitModes() {
+    for (Unit& unit : units) {
+        if (unit.fd >= 0 && unit.serial && unit.textSeen) {
+            unit.textSeen = false;
+            sendBinaryMode(unit.fd, machines[unit.machine].name);
+        }
+    }
+}
+
+void readUnit(Unit& unit) {
+    uint8_t buf[READ_BUFFER_SIZE];
+    ssize_t n;
+    while ((n = read(unit.fd, buf, sizeof(buf))) > 0) {
+        for (ssize_t i = 0; i < n; i++) {
+            receiveByte(unit, buf[i]);
+        }
+    }
+    if ((size_t)unit.pending.size() >= (size_t)FLUSH_SAMPLES) {
+        flushUnit(unit);
+    }
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+        fprintf(stderr, "collector: %s closed\n", machines[unit.machine].name);
+        flushUnit(unit);
+        close(unit.fd);
+        unit.fd = -1;
+    }
+}
+
+// Frame parser, as on the controller. Text lines between frames (before the
+// unit switched mode) are skipped while looking for SYNC, and noted.
+void receiveByte(Unit& unit, uint8_t c) {
+    unit.sum += c;
+    switch (unit.state) {
+        case PARSE_SYNC:
+            if (c == TELEMETRY_SYNC) {
+                unit.sum = c;
+                unit.state = PARSE_LENGTH;
+            } else if (c == '\n') {
+                unit.textSeen = true;
+            }
+            break;
+
+        case PARSE_LENGTH:
+            if (c == 0) {
+                unit.state = PARSE_SYNC;
+                break;
+            }
+            unit.length = c;
+            unit.received = 0;
+            unit.state = PARSE_PAYLOAD;
+            break;
+
+        case PARSE_PAYLOAD:
+            unit.payload[unit.received++] = c;
+            if (unit.received == unit.length) {
+                unit.state = PARSE_CHECKSUM;
+            }
+            break;
+
+        case PARSE_CHECKSUM:
+            unit.state = PARSE_SYNC;
+            if (unit.sum == 0) {
+                receiveFrame(unit);
+            } else if (unit.synced) {
+                // Before the first frame the SYNC was likely text
+                unit.badFrames++;
+            }
+            break;
+    }
+}
+
+// Timestamp a telemetry frame and batch it. The time is the unit's own
+// clock on a host base taken at its first frame after a reboot, so serial
+// latency does not skew durations. The base never moves a sample before the
+// machine's newest one, so a block chain stays in time order. Timing and log
+// record frames are not kept.
+void receiveFrame(Unit& unit) {
+    if (unit.length != sizeof(TelemetryFrame)) {
+        return;
+    }
+    const uint8_t* p = unit.payload;
+    uint16_t seq = p[2] | (p[3] << 8);
+    uint32_t deviceMs = p[4] | (p[5] << 8) | (p[6] << 16) | ((uint32_t)p[7] << 24);
+
+    if (!unit.synced || deviceMs < unit.lastDeviceMs) {
+        unit.baseMs = hostMs() - deviceMs;
+        if (unit.baseMs + deviceMs < unit.lastMs) {
+            unit.baseMs = unit.lastMs - deviceMs;
+        }
+    } else {
+        unit.dropped += (uint16_t)(seq - unit.lastSeq - 1);
+    }
+    unit.synced = true;
+    unit.lastSeq = seq;
+    unit.lastDeviceMs = deviceMs;
+
+    Sample s;
+    s.timeMs = unit.baseMs + deviceMs;
+    unit.lastMs = s.timeMs;
+    s.type = p[0];
+    s.code = p[1];
+    for (int v = 0; v < 4; v++) {
+        s.values[v] = (int16_t)(p[8 + 2 * v] | (p[9 + 2 * v] << 8));
+    }
+    unit.pending.push_back(s);
+}
+
+// Collect from all ports until every one is closed or SIGINT/SIGTERM, flushing
+// batches every FLUSH_PERIOD_MS
+int record(const char* path, int argc, char** argv) {
+    if (!openStore(path)) {
+        return 1;
+    }
+    for (int i = 0; i < argc; i++) {
+        openUnit(argv[i]);
+    }
+
+    int epollFd = epoll_create1(0);
+    for (size_t i = 0; i < units.size(); i++) {
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.u64 = i;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, units[i].fd, &ev) != 0) {
+            // Regular files cannot be polled, they are always readable
+            readUnit(units[i]);
+        }
+    }
+
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &signals, nullptr);
+    int signalFd = signalfd(-1, &signals, 0);
+    int timerFd = timerfd_create(CLOCK_MONOTONIC, 0);
+    itimerspec period = {{FLUSH_PERIOD_MS / 1000, (FLUSH_PERIOD_MS % 1000) * 1000000},
+                         {FLUSH_PERIOD_MS / 1000, (FLUSH_PERIOD_MS % 1000) * 1000000}};
+    timerfd_settime(timerFd, 0, &period, nullptr);
+
+    const uint64_t SIGNAL_TAG = UINT64_MAX;
+    const uint64_t TIMER_TAG = UINT64_MAX - 1;
+    epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.u64 = SIGNAL_TAG;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, signalFd, &ev);
+    ev.data.u64 = TIMER_TAG;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, timerFd, &ev);
+
+    bool running = true;
+    while (running) {
+        int connected = 0;
+        for (const Unit& unit : units) {
+            connected += unit.fd >= 0;
+        }
+        if (connected == 0) {
+            break;
+        }
+
+        epoll_event events[MAX_EPOLL_EVENTS];
+        int n = epoll_wait(epollFd, events, MAX_EPOLL_EVENTS, -1);
+        for (int i = 0; i < n; i++) {
+            uint64_t tag = events[i].data.u64;
+            if (tag == SIGNAL_TAG) {
+                running = false;
+            } else if (tag == TIMER_TAG) {
+                uint64_t expirations;
+                if (read(timerFd, &expirations, sizeof(expirations)) > 0) {
+                    flushAll();
+                    checkUnitModes();
+                }
+            } else if (units[tag].fd >= 0) {
+                readUnit(units[tag]);
+            }
+        }
+    }
+
+    bool ok = flushAll();
+    for (Unit& unit : units) {
+        if (unit.fd >= 0) {
+            close(unit.fd);
+        }
+    }
+    close(storeFd);
+    return ok ? 0 : 1;
+}
+
+// ---------------------------------------------------------------------------
+// Queries (read side)
+// ---------------------------------------------------------------------------
+
+const uint8_t* mapStore(const char* path, size_t& size) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror(path);
+        return nullptr;
+    }
+    size = st.st_size;
+    void* base = size >= DATA_OFFSET ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "collector: cannot map %s\n", path);
+        return nullptr;
+    }
+    const FileHeader* h = (const FileHeader*)base;
+    if (memcmp(h->magic, "WTSF", 4) != 0 || h->version != FILE_VERSION || h->blockSamples != BLOCK_SAMPLES) {
+        fprintf(stderr, "collector: %s is not a version %u store\n", path, FILE_VERSION);
+        return nullptr;
+    }
+    return (const uint8_t*)base;
+}
+
+// Visit a machine's samples in [from, to], oldest first. Blocks outside the
+// window are skipped on their header; only the time, type and code columns
+// are read.
+template<typename F>
+void forEachSample(const uint8_t* base, size_t size, int machine, int64_t from, int64_t to, F visit) {
+    const MachineEntry* m = (const MachineEntry*)(base + DIRECTORY_OFFSET) + machine;
+    for (uint64_t at = m->firstBlock; at != 0 && at + BLOCK_SIZE <= size;) {
+        const BlockHeader* block = (const BlockHeader*)(base + at);
+        if (block->magic != BLOCK_MAGIC || block->count > (uint32_t)BLOCK_SAMPLES) {
+            break;
+        }
+        if (block->count > 0 && block->lastMs >= from && block->firstMs <= to) {
+            const int64_t* times = (const int64_t*)(base + at + COLUMN_TIME);
+            const uint8_t* types = base + at + COLUMN_TYPE;
+            const uint8_t* codes = base + at + COLUMN_CODE;
+            for (uint32_t i = 0; i < block->count; i++) {
+                if (times[i] >= from && times[i] <= to) {
+                    visit(times[i], types[i], codes[i]);
+                }
+            }
+        }
+        at = block->next;
+    }
+}
+
+int listMachines(const char* path) {
+    size_t size;
+    const uint8_t* base = mapStore(path, size);
+    if (base == nullptr) {
+        return 1;
+    }
+    const FileHeader* h = (const FileHeader*)base;
+    const MachineEntry* m = (const MachineEntry*)(base + DIRECTORY_OFFSET);
+    printf("machine,samples,dropped,bad_frames,first_ms,last_ms\n");
+    for (uint32_t i = 0; i < h->machineCount; i++) {
+        int64_t first = 0;
+        int64_t last = 0;
+        if (m[i].firstBlock != 0) {
+            first = ((const BlockHeader*)(base + m[i].firstBlock))->firstMs;
+            last = ((const BlockHeader*)(base + m[i].lastBlock))->lastMs;
+        }
+        printf("%.32s,%llu,%u,%u,%lld,%lld\n", m[i].name, (unsigned long long)m[i].samples,
+               m[i].dropped, m[i].badFrames, (long long)first, (long long)last);
+    }
+    return 0;
+}
+
+// Cycles per machine from the event frames. A cycle runs from LOG_CYCLE_START
+// (or LOG_CYCLE_RESUMED after a power loss) to LOG_CYCLE_ENDED, a power off or
+// a reboot; paused time counts as in use. Utilisation is the running time over
+// the window (the machine's own samples if no window is given). The abort rate
+// is aborted over finished cycles; power losses are counted apart, as
+// interrupted.
+int queryCycles(const char* path, bool aborts, int64_t from, int64_t to) {
+    size_t size;
+    const uint8_t* base = mapStore(path, size);
+    if (base == nullptr) {
+        return 1;
+    }
+    const FileHeader* h = (const FileHeader*)base;
+    const MachineEntry* m = (const MachineEntry*)(base + DIRECTORY_OFFSET);
+    printf(aborts ? "machine,cycles,completed,aborted,interrupted,abort_rate\n" :
+                    "machine,cycles,running_s,window_s,utilisation\n");
+
+    for (uint32_t i = 0; i < h->machineCount; i++) {
+        int cycles = 0;
+        int completed = 0;
+        int aborted = 0;
+        int interrupted = 0;
+        int64_t runningMs = 0;
+        int64_t startMs = -1;       // Open cycle
+        int outcome = 0;            // 1 completed, 2 aborted
+        int64_t firstMs = -1;
+        int64_t lastMs = -1;
+
+        auto endCycle = [&](int64_t endMs) {
+            runningMs += endMs - startMs;
+            completed += outcome == 1;
+            aborted += outcome == 2;
+            interrupted += outcome == 0;
+            startMs = -1;
+        };
+        forEachSample(base, size, i, from, to, [&](int64_t t, uint8_t type, uint8_t code) {
+            firstMs = firstMs < 0 ? t : firstMs;
+            lastMs = t;
+            if (type != TLM_EVENT) {
+                return;
+            }
+            if (code == LOG_CYCLE_START || code == LOG_CYCLE_RESUMED) {
+                if (startMs >= 0) {
+                    endCycle(t);
+                }
+                startMs = t;
+                outcome = 0;
+                cycles++;
+            } else if (startMs >= 0 && code == LOG_CYCLE_COMPLETE) {
+                outcome = 1;
+            } else if (startMs >= 0 && (code == LOG_ABORT_DOOR || code == LOG_CYCLE_CANCELLED || code == LOG_ABORT_FAULT)) {
+                outcome = 2;
+            } else if (startMs >= 0 && (code == LOG_CYCLE_ENDED || code == LOG_POWER_OFF || code == LOG_BOOT)) {
+                endCycle(t);
+            }
+        });
+        int64_t windowStart = from > INT64_MIN ? from : firstMs;
+        int64_t windowEnd = to < INT64_MAX ? to : lastMs;
+        if (startMs >= 0) {
+            // Still running at the end of the data
+            runningMs += windowEnd - startMs;
+        }
+
+        if (aborts) {
+            int finished = completed + aborted;
+            printf("%.32s,%d,%d,%d,%d,%.3f\n", m[i].name, cycles, completed, aborted, interrupted,
+                   finished ? (double)aborted / finished : 0.0);
+        } else {
+            int64_t windowMs = windowEnd - windowStart;
+            printf("%.32s,%d,%.1f,%.1f,%.3f\n", m[i].name, cycles, runningMs / 1000.0, windowMs / 1000.0,
+                   windowMs > 0 ? (double)runningMs / windowMs : 0.0);
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc >= 4 && strcmp(argv[1], "record") == 0) {
+        return record(argv[2], argc - 3, argv + 3);
+    }
+    if (argc == 3 && strcmp(argv[1], "list") == 0) {
+        return listMachines(argv[2]);
+    }
+    bool utilisation = argc >= 3 && strcmp(argv[1], "utilisation") == 0;
+    bool aborts = argc >= 3 && strcmp(argv[1], "aborts") == 0;
+    if ((utilisation || aborts) && (argc == 3 || argc == 5)) {
+        int64_t from = argc == 5 ? atoll(argv[3]) * 1000 : INT64_MIN;
+        int64_t to = argc == 5 ? atoll(argv[4]) * 1000 : INT64_MAX;
+        return queryCycles(argv[2], aborts, from, to);
+    }
+    fprintf(stderr, "usage: collector record FILE [name=]PORT...\n"
+                    "       collector list FILE\n"
+                    "       collector utilisation FILE [FROM TO]\n"
+                    "       collector aborts FILE [FROM TO]\n");
+    return 2;
+}
@@ -1,30 +1,741 @@
 #include "mbed.h"
-#include <cstdio>
+#include "telemetry_protocol.h"
 #include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
 
-// Possible System States
+// Build options (override with -D)
+#ifndef WASHER_MS_PER_MINUTE
+#define WASHER_MS_PER_MINUTE 1000     // Cycle clock scale
+#endif
+
+// Possible System States, nested as listed in STATE_INFO. RUNNING keeps
+// the cycle phase (cyclePhase) as its sub-state, so a pause returns to it.
 enum SystemState {
     OFF,
+    ON,                 // Superstate only, never current
     IDLE,
-    RUNNING
+    DOOR_OPEN_FAULT,    // IDLE with the door open, start inhibited
+    OVERLOAD_FAULT,     // IDLE with the drum overloaded, start inhibited
+    RUNNING,
+    PAUSED,             // Cycle clock frozen, outputs parked
+    PAUSED_DOOR_OPEN,   // PAUSED with the door open, resume inhibited
+    CALIBRATING,        // Sensor calibration steps, from IDLE
+    SAVING_SETTINGS,    // IDLE while the settings sector is rewritten, start inhibited
+    NUM_SYSTEM_STATES
+};
+
+// State machine events, all dispatched on the control thread
+enum MachineEvent {
+    EV_NONE,
+    EV_POWER,             // Power button press
+    EV_START,             // Short start/pause press
+    EV_LONG_PRESS,        // Long start/pause press
+    EV_DOOR_OPENED,
+    EV_DOOR_CLOSED,
+    EV_OVERLOAD,
+    EV_LOAD_OK,
+    EV_SENSOR_REPORT,     // New snapshot from the safety thread
+    EV_PHASE_END,         // Cycle clock passed the current phase
+    EV_CYCLE_END,         // Cycle clock passed the whole cycle
+    EV_IMBALANCE,         // Drum vibration at the spin frequency (safety thread)
+    EV_DOOR_STILL_OPEN,   // On entering IDLE: door left open
+    EV_STILL_OVERLOADED,  // On entering IDLE: load still too heavy
+    EV_CALIBRATE,         // Sensor calibration requested (serial)
+    EV_CALIBRATION_DONE,  // Last calibration step sampled
+    EV_FAULT,             // Fault manager forced the outputs off (safety thread)
+    EV_CYCLE_STARTED,     // Start press in IDLE began or resumed a cycle
+    EV_STILL_SAVING,      // On entering IDLE: settings sector write still running
+    EV_SETTINGS_SAVED,    // Settings sector write finished (telemetry thread)
+    NUM_MACHINE_EVENTS
+};
+
+// ADC scan channels, in conversion order
+enum AdcChannel {
+    ADC_RPM,
+    ADC_TEMP_SET,
+    ADC_TIME,
+    ADC_FSR,
+    ADC_TEMP,
+    ADC_LDR,
+    NUM_ADC_CHANNELS
+};
+
+// Wash cycle phases, in running order
+enum CyclePhase {
+    PHASE_FILL,
+    PHASE_HEAT,
+    PHASE_WASH,
+    PHASE_RINSE,
+    PHASE_SPIN,
+    PHASE_DRAIN,
+    NUM_PHASES
+};
+
+// FSR load bands, used by the RGB indicator and the cycle planner
+enum LoadClass {
+    LOAD_CLASS_LIGHT,
+    LOAD_CLASS_NORMAL,
+    LOAD_CLASS_MEDIUM,
+    LOAD_CLASS_HEAVY,
+    LOAD_CLASS_OVERLOAD,
+    NUM_LOAD_CLASSES
+};
+
+// How a wash cycle ended (stored in the cycle log)
+enum CycleOutcome {
+    OUTCOME_COMPLETE,
+    OUTCOME_DOOR_ABORT,
+    OUTCOME_POWER_OFF,
+    OUTCOME_CANCELLED,
+    OUTCOME_FAULT,
+    NUM_OUTCOMES
+};
+
+// Debounced input events
+enum ButtonEvent {
+    BUTTON_PRESSED,      // Debounced press
+    BUTTON_RELEASED,     // Debounced release, with how long it was held
+    BUTTON_LONG_PRESS    // Still held after LONG_PRESS_MS, once per press
+};
+
+enum ButtonId {
+    BUTTON_POWER,
+    BUTTON_START,
+    NUM_BUTTONS
+};
+
+// Binary command frame receiver state
+enum CommandParseState {
+    PARSE_TEXT,      // Not in a frame, bytes are text commands
+    PARSE_LENGTH,
+    PARSE_PAYLOAD,
+    PARSE_CHECKSUM
+};
+
+// Tasks the watchdog supervisor expects to check in
+enum SupervisedTask {
+    TASK_SAFETY,         // safetyTick() (safety thread)
+    TASK_CONTROL,        // onSensorReading() (control thread)
+    TASK_PID,            // pidTick() (timer ISR)
+    NUM_SUPERVISED_TASKS
+};
+
+// Why the fault manager forced the outputs off
+enum FaultCause {
+    FAULT_NONE,
+    FAULT_MISSED_DEADLINE,   // A supervised task stopped checking in, the watchdog resets
+    FAULT_DOOR_OPEN,         // Door open with the heater or motor driven
+    FAULT_OVERTEMP,          // Drum above TEMP_FAULT_LIMIT with the heater or motor driven
+    NUM_FAULT_CAUSES
+};
+
+// Instrumented code sections
+enum TimingSection {
+    TIME_BUTTONS,        // Button press handlers
+    TIME_SENSORS,        // readAndProcessSensors()
+    TIME_CYCLE,          // updateCycle()
+    TIME_BEEP,           // queueBeep()
+    TIME_TICK_INTERVAL,  // Start-to-start period of the control tick (jitter)
+    TIME_PID,            // pidTick() (timer ISR)
+    NUM_TIMING_SECTIONS
+};
+
+// Slices of the static memory arena, in arena order
+enum MemoryPool {
+    POOL_SAFETY_QUEUE,
+    POOL_CONTROL_QUEUE,
+    POOL_UI_QUEUE,
+    POOL_TELEMETRY_QUEUE,
+    POOL_SAFETY_STACK,
+    POOL_UI_STACK,
+    POOL_TELEMETRY_STACK,
+    NUM_MEMORY_POOLS
 };
 
 // Constants
 const float FREQUENCY = 100.0f;           // RGB LED PWM frequency (Hz)
-const float FSR_THRESHOLD = 0.1f;         // Force sensor serial output threshold (10%)
-const float LDR_THRESHOLD = 15.0f;        // Light sensor serial output threshold (15%)
-const float TEMP_THRESHOLD = 5.0f;        // Temperature change threshold (5°C)
-const float DOOR_OPEN_THRESHOLD = 40.0f;  // Door open threshold (light > 40%)
-const float TEMP_SENSOR_CALIBRATION = 0.5f;// Temperature calibration 
+const int FSR_THRESHOLD = 100;            // Force sensor serial output threshold (10% = 100‰)
+const int LDR_THRESHOLD = 150;            // Light sensor serial output threshold (15% = 150 × 0.1%)
+const int TEMP_THRESHOLD = 50;            // Temperature change threshold (5°C = 50 × 0.1°C)
+const int DOOR_OPEN_THRESHOLD = 400;      // Door open threshold until calibrated (light > 40% = 400 × 0.1%)
+const float TEMP_SENSOR_CALIBRATION = 0.5f;// Temperature sensor gain until calibrated
 const float FILTER_ALPHA = 0.3f;          // Low-pass filter coefficient
-const int DEBOUNCE_COUNT = 3;             // Button debounce count
-const int NUM_SAMPLES = 5;                // Sensor averaging samples
+const int DEBOUNCE_COUNT = 3;             // Door debounce count (sensor readings)
+const int NUM_SAMPLES = 5;                // Sample window per channel (max median taps)
+const int BEEP_QUEUE_SIZE = 8;            // Buzzer sequencer queue length
+const int BUTTON_SAMPLE_US = 1000;        // Button sampling period (1 ms)
+const uint8_t BUTTON_STABLE_MASK = 0xFF;  // Samples that must agree (8 ms)
+const int LONG_PRESS_MS = 1500;           // Hold time for a long press
+const int BUTTON_WAKE_MS = 100;           // Standby wake edge with no press after this goes back to sleep
+const int CONTROL_PERIOD_MS = 100;        // Sensor processing and cycle tick period
+const int DISPLAY_PERIOD_MS = 100;        // Display refresh period
+const int DISPLAY_DIGIT_TICKS = 4;        // Refresh periods each digit is lit (followed by one blank)
+const int DISPLAY_MAX_FRAMES = 8;         // Display framebuffer length (digits)
+const int STANDBY_RETRY_MS = 20;          // Standby entry retry while the buzzer finishes
+const int MS_PER_CYCLE_MINUTE = WASHER_MS_PER_MINUTE;  // Cycle clock scale (1 s per minute for demo, 60000 for real time)
+const int REDISTRIBUTE_MS = MS_PER_CYCLE_MINUTE / 2;  // Tumble time of a redistribution pass
+const int SERIAL_BAUD = 115200;           // Serial port baud rate (console and telemetry)
+const uint32_t ARENA_FILL = 0xDEADBEEF;   // Memory arena fill, never-written words keep it
+const int HEAP_CHECK_PERIOD_MS = 1000;    // Heap guard check period
+const int TELEMETRY_QUEUE_SIZE = 64;      // Telemetry ring buffer frames (power of 2)
+const bool TELEMETRY_BINARY = false;      // Binary frames instead of text lines on the serial port at boot
+const int COMMAND_MAX_PAYLOAD = 16;       // Largest command frame payload
+const int SERIAL_RX_BUDGET = 64;          // Bytes parsed per control thread event, the rest is re-queued
+const int TIMING_BUCKETS = 32;            // log2 latency histogram buckets
+const int CYCLE_LOG_SECTORS = 2;          // Flash sectors at the end of flash holding the cycle log
+const int CYCLE_LOG_BATCH = 4;            // Records queued for one flash program
+const int CYCLE_LOG_DUMP = 10;            // Newest records printed by the 'l' command
+const uint32_t CYCLE_LOG_FREE = 0xFFFFFFFF;   // Erased record sequence number
+const int CHECKPOINT_WORDS = 5;           // Backup registers per checkpoint slot
+const int CHECKPOINT_SLOTS = 2;           // Double buffered, BKP0R onwards
+const uint32_t CHECKPOINT_MAGIC = 0xC7C1; // Marks a written slot
+const uint32_t CHECKPOINT_KEY = 0xA5A5A5A5;   // Folded into the check word, all-zero slots never validate
+
+// Fault manager. Worst case from the fault to the heater and motor off:
+// - door open: in the safety tick whose debounced reading shows it,
+//   DEBOUNCE_COUNT ticks (300 ms) after the filtered light crosses the
+//   threshold;
+// - overtemperature: in the first safety tick that reads it;
+// - a task that stops: its deadline plus one supervisor period from its
+//   last check-in (SAFE_STATE_BOUND_MS, 600 ms), then the watchdog resets;
+// - interrupts stopped too: the watchdog resets WATCHDOG_TIMEOUT_MS after
+//   the last kick, and the reset releases the output pins.
+const int WATCHDOG_TIMEOUT_MS = 2500;     // IWDG timeout, above the longest flash sector erase
+const int FLASH_ERASE_MAX_MS = 2000;      // 128 KB sector erase, worst case (STM32F4)
+const int SUPERVISOR_PERIOD_MS = 100;     // Deadline checks and watchdog kicks
+const int TEMP_FAULT_LIMIT = 950;         // Drum temperature that trips the fault manager (0.1°C)
+const int FAULT_REGISTER = CHECKPOINT_SLOTS * CHECKPOINT_WORDS;   // Backup register after the checkpoints (BKP10R)
+const uint32_t FAULT_RECORD_MAGIC = 0xFA17;   // Top half of a written fault record
+const int MODE_REGISTER = FAULT_REGISTER + 1;   // Backup register keeping the telemetry mode across resets (BKP11R)
+const uint32_t MODE_RECORD_MAGIC = 0x7E1E;    // Top half of a written telemetry mode
+
+// Sensor calibration: door light levels closed and open, and one
+// temperature reference point for the sensor gain
+const int CALIBRATION_SAMPLES = 10;       // Sensor reports averaged per step (1 s)
+const int CALIBRATION_MIN_CONTRAST = 100; // Door open must read this much brighter (‰ light)
+const int CALIBRATION_MAX_REF_C = 95;     // Highest reference temperature (°C)
+const int TEMP_GAIN_MIN_PERCENT = 50;     // Accepted gain, of the nominal sensor's
+const int TEMP_GAIN_MAX_PERCENT = 200;
+const uint16_t CALIBRATION_MAGIC = 0xCA1B;   // Marks a written calibration record
+const int CAL_DOOR_CLOSED = 0;            // Calibration steps, in order
+const int CAL_DOOR_OPEN = 1;
+const int CAL_TEMPERATURE = 2;
+
+const char* const PHASE_NAMES[NUM_PHASES] = {"Fill", "Heat", "Wash", "Rinse", "Spin", "Drain"};
+
+// Closed-loop control: motor every PID tick, heater every HEATER_TICK_DIVIDER ticks
+const int PID_TICK_US = 1000;             // Motor loop period (1 kHz)
+const int HEATER_TICK_DIVIDER = 100;      // Heater loop period in PID ticks (10 Hz)
+const int PID_FRAC_BITS = 8;              // PID gains are Q8
+const int PID_OUTPUT_MAX = 1000;          // PID output full scale (‰ duty)
+const int HEATER_PWM_PERIOD_MS = 100;     // Heater PWM period (slow, relay friendly)
+const int MOTOR_PWM_PERIOD_US = 50;       // Motor PWM period (20 kHz, above hearing)
+const int MOTOR_MAX_RPM = 1200;           // Drum speed at full duty
+const int MOTOR_TAU_MS = 300;             // Drum speed time constant (model)
+const int TUMBLE_RPM = 60;                // Drum speed while washing and rinsing
+const int SPIN_SETTING = -1;              // Motor speed entry: follow the RPM pot
+
+// Energy metering: PWM duty integrated in the PID ISR against the power at
+// full duty (measure each drive once, the element and motor ratings vary)
+const int HEATER_POWER_W = 2000;          // Heater element at full duty
+const int MOTOR_POWER_W = 250;            // Drum motor at full duty
+const int JOULES_PER_ENERGY_UNIT = 360;   // CycleRecord energy unit (0.1 Wh)
+
+// Eco heating: the heater runs only as hard as it needs to for the drum to
+// be warm partway into the wash, instead of at full power and then holding
+// the heat phase. The water spends less time hot and the cycle keeps its length.
+const int ECO_HEAT_TARGET_PERCENT = 50;   // Share of the wash phase by which the drum should be warm
+const int ECO_HEAT_MARGIN_PERCENT = 125;  // Estimated duty scaled up for a slower than expected drum
+const int ECO_MIN_DUTY = 300;             // Heater duty floor (‰), below it losses eat the saving
+
+// Imbalance detection: the FSR is captured at 1 kHz while the drum spins and
+// one Goertzel bin per block measures the vibration at the drum frequency
+const int VIBRATION_SAMPLE_MS = 1;        // FSR capture period during spin (1 kHz)
+const int VIBRATION_RATE_HZ = 1000 / VIBRATION_SAMPLE_MS;
+const int VIBRATION_BLOCK = 250;          // Samples per Goertzel block (4 Hz bins)
+const int VIBRATION_MIN_RPM = 400;        // Drum setpoint the capture starts at
+const int VIBRATION_THRESHOLD = 40;       // Imbalance amplitude (‰ of FSR full scale)
+const int VIBRATION_CONFIRM_BLOCKS = 2;   // Consecutive blocks over the threshold
+const int GOERTZEL_FRAC_BITS = 16;        // Goertzel coefficient is Q16
+const int MAX_REDISTRIBUTIONS = 2;        // Tumble passes before the spin is slowed
+const int SPIN_REDUCED_PERCENT = 60;      // Spin speed kept once redistributing has failed
+
+// Goertzel output power for a sine of threshold amplitude: (A × N / 2)², A in 12-bit counts
+const int64_t VIBRATION_POWER_LIMIT =
+    (int64_t)(VIBRATION_THRESHOLD * 4096 / 1000 * VIBRATION_BLOCK / 2) * (VIBRATION_THRESHOLD * 4096 / 1000 * VIBRATION_BLOCK / 2);
+
+// Per phase actuators: heater on/off and drum speed (RPM, 0 = stopped)
+const bool PHASE_HEATING[NUM_PHASES] = {false, true, true, false, false, false};
+const int PHASE_MOTOR_RPM[NUM_PHASES] = {0, 0, TUMBLE_RPM, TUMBLE_RPM, SPIN_SETTING, 0};
+
+// Heat phase: it runs on past its planned time until the drum is warm, and
+// the remaining time is predicted from the measured heating rate
+const int HEAT_REACHED_TOLERANCE = 20;    // Drum counts as warm this close to the setting (0.1°C)
+const int HEAT_HOLD_MAX_PERCENT = 100;    // Longest hold, of the planned heat phase
+const int HEAT_RATE_MIN_MS = 5000;        // Heating measured this long before its rate is used
+const int HEAT_RATE_PRIOR_MS = 20000;     // Weight of the prior rate against the measurement
+const int HEAT_HISTORY_CYCLES = 16;       // Newest measured cycles per load class its prior rate comes from
+
+// Load level thresholds (‰ of FSR full scale)
+const int LOAD_LIGHT = 200;               // Light load
+const int LOAD_MEDIUM = 400;              // Medium load
+const int LOAD_HEAVY = 600;               // Heavy load
+const int LOAD_OVERLOAD = 700;            // Overload condition
+const char* const LOAD_CLASS_NAMES[NUM_LOAD_CLASSES] = {"light", "normal", "medium", "heavy", "overload"};
+
+// Heating rate per load class with no cycle history (m°C/s, more water heats slower)
+const int HEAT_RATE_DEFAULTS[NUM_LOAD_CLASSES] = {40, 33, 28, 22, 22};
+
+// RGB indicator colour per load class
+const float LOAD_COLORS[NUM_LOAD_CLASSES][3] = {
+    {0.0f, 1.0f, 0.0f},  // Green for light load
+    {0.5f, 1.0f, 0.0f},  // Yellowish for normal load
+    {1.0f, 1.0f, 0.0f},  // Yellow for medium load
+    {1.0f, 0.5f, 0.0f},  // Orange for heavy load
+    {1.0f, 0.0f, 0.0f}   // Red for overload
+};
+
+// Cycle planner: phase layout by load class and wash temperature
+const int PLAN_HOT_TEMP = 40;             // Setpoint (°C) from which the hot plans apply
+const int NUM_TEMP_BANDS = 2;             // Cold, hot
+
+struct CyclePlan {
+    uint8_t timePercent;                  // Share of the pot time actually run
+    uint8_t phasePercent[NUM_PHASES];     // Fill, heat, wash, rinse, spin, drain (sums to 100)
+    uint16_t spinRampRpmPerS;             // Spin-up rate, gentler for heavier (less balanced) loads
+};
+
+// Light loads run shorter with less heating, heavy loads longer with a slow spin-up.
+// Overloaded drums never start, so the table has no row for them.
+constexpr CyclePlan CYCLE_PLANS[LOAD_CLASS_OVERLOAD][NUM_TEMP_BANDS] = {
+    {{70, {10, 5, 35, 25, 20, 5}, 200},   {75, {10, 15, 30, 20, 20, 5}, 200}},   // Light
+    {{85, {10, 10, 35, 20, 20, 5}, 150},  {90, {10, 15, 35, 20, 15, 5}, 150}},   // Normal
+    {{100, {10, 10, 35, 25, 15, 5}, 120}, {100, {10, 15, 35, 20, 15, 5}, 120}},  // Medium
+    {{110, {10, 10, 35, 25, 15, 5}, 80},  {115, {10, 20, 30, 20, 15, 5}, 80}}    // Heavy
+};
+
+// Every plan must lay out the whole cycle
+constexpr bool plansCoverCycle() {
+    for (int c = 0; c < LOAD_CLASS_OVERLOAD; c++) {
+        for (int b = 0; b < NUM_TEMP_BANDS; b++) {
+            int sum = 0;
+            for (int p = 0; p < NUM_PHASES; p++) {
+                sum += CYCLE_PLANS[c][b].phasePercent[p];
+            }
+            if (sum != 100) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+static_assert(plansCoverCycle(), "CYCLE_PLANS phase shares must sum to 100");
+
+// Wash programs: a versioned table read in place (flash is memory mapped, so
+// there is no parsing and no copy). Fields are naturally aligned with no
+// padding, multi-byte values little endian, so the layout is the file format.
+const uint32_t PROGRAM_TABLE_MAGIC = 0x47525057;   // "WPRG"
+const uint16_t PROGRAM_TABLE_VERSION = 1;
+const int MAX_PROGRAMS = 8;
+const int PROGRAM_NAME_LEN = 12;
+const int MANUAL_PROGRAM = 0;             // Program number of the pot settings, tables count from 1
+const int PROGRAM_MAX_TEMP = 90;          // Hottest phase setpoint accepted (°C)
+const int PROGRAM_MAX_S = 99 * 60;        // Longest program (cycle seconds, two display digits of minutes)
+const int UPLOAD_IDLE = -1;               // No program table upload in progress
+const int UPLOAD_DISCARD = -2;            // Bad upload, ignoring the rest of the line
+
+// One phase of a program, also the per-phase actuators of any running cycle
+struct ProgramPhase {
+    uint16_t durationS;       // Cycle seconds, 0 skips the phase
+    uint16_t rpm;             // Drum speed, the ramp's target when rampRpmPerS is set
+    uint16_t rampRpmPerS;     // Spin-up from TUMBLE_RPM, 0 for a fixed speed
+    uint8_t tempC;            // Heater setpoint, 0 for unheated
+    uint8_t reserved;
+};
+static_assert(sizeof(ProgramPhase) == 8, "ProgramPhase must stay 8 bytes");
+
+struct WashProgram {
+    char name[PROGRAM_NAME_LEN];          // NUL padded
+    ProgramPhase phases[NUM_PHASES];      // Fill, heat, wash, rinse, spin, drain
+    uint8_t reserved[4];
+};
+static_assert(sizeof(WashProgram) == 64, "WashProgram must stay 64 bytes");
+
+struct ProgramTableHeader {
+    uint32_t magic;           // PROGRAM_TABLE_MAGIC
+    uint16_t version;         // PROGRAM_TABLE_VERSION
+    uint8_t count;            // Programs that follow, 1 to MAX_PROGRAMS
+    uint8_t programSize;      // sizeof(WashProgram)
+    uint32_t checksum;        // Sum of the program bytes
+    uint32_t reserved;
+};
+static_assert(sizeof(ProgramTableHeader) == 16, "ProgramTableHeader must stay 16 bytes");
+
+struct ProgramTable {
+    ProgramTableHeader header;
+    WashProgram programs[MAX_PROGRAMS];   // Only the first header.count are stored
+};
+
+// Built-in programs, used until a valid table is uploaded. Phases are
+// {seconds, RPM, ramp RPM/s, °C, reserved}.
+constexpr ProgramTable BUILTIN_PROGRAMS = {
+    {PROGRAM_TABLE_MAGIC, PROGRAM_TABLE_VERSION, 4, sizeof(WashProgram), 0, 0},
+    {
+        {"Cotton",     {{240, 0, 0, 0, 0}, {600, 0, 0, 60, 0}, {1500, TUMBLE_RPM, 0, 60, 0},
+                        {900, TUMBLE_RPM, 0, 0, 0}, {600, 1000, 150, 0, 0}, {180, 0, 0, 0, 0}}, {}},
+        {"Synthetics", {{240, 0, 0, 0, 0}, {360, 0, 0, 40, 0}, {1200, TUMBLE_RPM, 0, 40, 0},
+                        {720, TUMBLE_RPM, 0, 0, 0}, {300, 800, 100, 0, 0}, {180, 0, 0, 0, 0}}, {}},
+        {"Quick",      {{120, 0, 0, 0, 0}, {0, 0, 0, 0, 0}, {600, TUMBLE_RPM, 0, 30, 0},
+                        {300, TUMBLE_RPM, 0, 0, 0}, {240, 800, 200, 0, 0}, {60, 0, 0, 0, 0}}, {}},
+        {"Eco",        {{240, 0, 0, 0, 0}, {300, 0, 0, 40, 0}, {2400, TUMBLE_RPM, 0, 40, 0},
+                        {900, TUMBLE_RPM, 0, 0, 0}, {480, 900, 120, 0, 0}, {180, 0, 0, 0, 0}}, {}}
+    }
+};
+
+// A program the cycle engine can run: named, not empty, actuators in range
+constexpr bool programWellFormed(const WashProgram& program) {
+    if (program.name[0] == '\0' || program.name[PROGRAM_NAME_LEN - 1] != '\0') {
+        return false;
+    }
+    uint32_t total = 0;
+    for (int p = 0; p < NUM_PHASES; p++) {
+        const ProgramPhase& phase = program.phases[p];
+        if (phase.rpm > MOTOR_MAX_RPM || phase.tempC > PROGRAM_MAX_TEMP) {
+            return false;
+        }
+        total += phase.durationS;
+    }
+    return total > 0 && total <= PROGRAM_MAX_S;
+}
+
+constexpr bool builtinProgramsWellFormed() {
+    for (int i = 0; i < BUILTIN_PROGRAMS.header.count; i++) {
+        if (!programWellFormed(BUILTIN_PROGRAMS.programs[i])) {
+            return false;
+        }
+    }
+    return BUILTIN_PROGRAMS.header.count <= MAX_PROGRAMS;
+}
+static_assert(builtinProgramsWellFormed(), "BUILTIN_PROGRAMS has a program the engine cannot run");
+
+// Filter bank: median taps per channel (1 = off), then a low-pass on every channel
+const int MEDIAN_TAPS[NUM_ADC_CHANNELS] = {
+    1,  // RPM pot
+    1,  // Temp pot
+    1,  // Time pot
+    5,  // FSR, rejects load spikes
+    1,  // Temp sensor
+    3   // LDR, rejects light flicker while keeping door response quick
+};
+const int FILTER_FRAC_BITS = 4;           // Extra fraction bits in the low-pass state
+const int32_t FILTER_ALPHA_Q15 = (int32_t)(FILTER_ALPHA * 32768.0f + 0.5f);
+
+// Fixed-point sensor scaling: units = raw ADC (0-65535) × FULL_SCALE >> 16
+const uint32_t LOAD_FULL_SCALE = 1000;    // Load in ‰
+const uint32_t LIGHT_FULL_SCALE = 1000;   // Light in 0.1%
+const uint32_t TEMP_FULL_SCALE = (uint32_t)(330.0f * TEMP_SENSOR_CALIBRATION * 10.0f);  // Temp in 0.1°C, until calibrated
+
+// Pot lookup tables are indexed by the top POT_LUT_BITS of the raw reading
+const int POT_LUT_BITS = 6;
+const int POT_LUT_SIZE = 1 << POT_LUT_BITS;
+
+// Pot position (0.0-1.0) to setting, evaluated at compile time only
+constexpr int rpmFromPot(float pos) { return (int)(pos * 7.0f + 2.0f) * 100; }   // 2-9 × 100
+constexpr int tempFromPot(float pos) { return (int)(pos * 4.0f + 2.0f) * 10; }   // 2-6 × 10
+constexpr int timeFromPot(float pos) {                                           // 1-9 × 10 minutes
+    int steps = (int)(pos * 8.0f + 0.5f) + 1;
+    return (steps > 9 ? 9 : steps) * 10;
+}
+
+// Pot setting lookup table, generated from one of the mappings above
+template <int (*Map)(float)>
+struct PotLut {
+    uint16_t value[POT_LUT_SIZE];
+    constexpr PotLut() : value() {
+        for (int i = 0; i < POT_LUT_SIZE; i++) {
+            value[i] = (uint16_t)Map((float)i / (POT_LUT_SIZE - 1));
+        }
+    }
+};
+
+constexpr PotLut<rpmFromPot> RPM_LUT;
+constexpr PotLut<tempFromPot> TEMP_LUT;
+constexpr PotLut<timeFromPot> TIME_LUT;
+
+// Text for each LogEvent (printf format, up to three int arguments)
+const char* const LOG_TEXT[NUM_LOG_EVENTS] = {
+    "🔄 System starting in OFF state\n",
+    "🟢 [System On]\n",
+    "🔴 [System Off]\n",
+    "▶️ Starting wash cycle: %d RPM, %d°C, %d minutes\n",
+    "🔁 Phase: %s\n",
+    "⏳ Cycle countdown: %d0 minutes remaining\n",
+    "✅ 🧼 Cycle complete!\n",
+    "❗⚠️ Door opened! Cycle aborted.\n",
+    "⏹️ Cycle ended\n",
+    "⚠️ Cycle already in progress\n",
+    "❌ Cannot start: Door is open! Close door first.\n",
+    "❌ Cannot start: Washer overloaded! Reduce load.\n",
+    "❗⚠️ WARNING: 🧺 Washer overloaded!\n",
+    "✅ Load level acceptable\n",
+    "📋 Cycle plan: %s load, %d minutes, spin ramp %d RPM/s\n",
+    "⏯️ Interrupted cycle found: %d minutes left, press start to resume\n",
+    "▶️ Resuming wash cycle: %d RPM, %d°C, %d minutes left\n",
+    "✋ Cycle cancelled (long press)\n",
+    "⏸️ Cycle paused: %d minutes left\n",
+    "▶️ Cycle continuing: %d minutes left\n",
+    "❌ Cannot continue: Door is open! Close door first.\n",
+    "❗⚠️ Heap used after boot: %d bytes\n",
+    "🧺 Program %d: %s, %d minutes\n",
+    "🎛️ Manual settings (pots)\n",
+    "🧺 Program table loaded: %d programs\n",
+    "❌ Program table rejected (%d bytes received)\n",
+    "❌ Program table not accepted now: cycle active or write in progress\n",
+    "❗⚠️ Program table write failed, using built-in programs\n",
+    "⚖️ Drum imbalance at %d RPM: redistributing the load (%d of %d)\n",
+    "⚖️ Drum still unbalanced: spin limited to %d RPM\n",
+    "🌡️ Heating on: drum at %d°C, waiting for %d°C\n",
+    "🌡️ Drum at %d°C, heating done\n",
+    "❗⚠️ Heating timed out at %d°C, continuing the cycle\n",
+    "❌ Command not possible now\n",
+    "⚡ Cycle used %d.%d Wh, %d%% of it heating\n",
+    "🌿 Eco heating on from the next cycle\n",
+    "🌿 Eco heating off from the next cycle\n",
+    "🔧 Calibration 1/3: close the door, then press start\n",
+    "🔧 Calibration 2/3: open the door, then press start\n",
+    "🔧 Calibration 3/3: enter the drum temperature (°C), then press start (none keeps the gain)\n",
+    "🔧 Calibrated: door open above %d‰ light, temperature gain %d%%\n",
+    "❗⚠️ Calibration failed: door light %d‰ closed and %d‰ open, too close\n",
+    "❗⚠️ Calibration failed: sensor reads %d°C at %d°C\n",
+    "🔧 Calibration cancelled\n",
+    "❗⚠️ Calibration in use but not saved\n",
+    "🔧 Sensor calibration loaded: door open above %d‰ light, temperature gain %d%%\n",
+    "🛡️ Heater and motor off: %s\n",
+    "❗⚠️ Cycle aborted by the fault manager\n",
+    "🐕 Watchdog reset: the %s task missed its deadline\n",
+    "🛡️ Fault before the reset: %s\n",
+    "🐕 Watchdog reset with no fault recorded\n",
+    "❌ Cannot start: saving settings, try again in a moment\n"
+};
+
+static_assert((TELEMETRY_QUEUE_SIZE & (TELEMETRY_QUEUE_SIZE - 1)) == 0, "TELEMETRY_QUEUE_SIZE must be a power of 2");
+
+const char* const OUTCOME_NAMES[NUM_OUTCOMES] = {"complete", "door abort", "power off", "cancelled", "fault"};
+
+const char* const TIMING_NAMES[NUM_TIMING_SECTIONS] = {"buttons", "sensors", "cycle", "beep", "tick", "pid"};
+const char* const TASK_NAMES[NUM_SUPERVISED_TASKS] = {"safety", "control", "pid"};
+const char* const FAULT_NAMES[NUM_FAULT_CAUSES] = {
+    "none", "missed deadline", "door open while running", "drum overtemperature"
+};
+
+// Longest a task may go without checking in while it is supervised: a few
+// of its periods, at least one supervisor period
+constexpr int TASK_DEADLINE_MS[NUM_SUPERVISED_TASKS] = {
+    3 * CONTROL_PERIOD_MS,    // safetyTick, every CONTROL_PERIOD_MS
+    5 * CONTROL_PERIOD_MS,    // A sensor report, every CONTROL_PERIOD_MS below the safety thread
+    SUPERVISOR_PERIOD_MS      // pidTick, every PID_TICK_US
+};
+constexpr int maxTaskDeadline(int i = 0) {
+    return i == NUM_SUPERVISED_TASKS ? 0 :
+           (TASK_DEADLINE_MS[i] > maxTaskDeadline(i + 1) ? TASK_DEADLINE_MS[i] : maxTaskDeadline(i + 1));
+}
+constexpr int SAFE_STATE_BOUND_MS = maxTaskDeadline() + SUPERVISOR_PERIOD_MS;
+static_assert(SAFE_STATE_BOUND_MS == 600, "Update the bound in the fault manager notes and README");
+static_assert(WATCHDOG_TIMEOUT_MS > FLASH_ERASE_MAX_MS + SUPERVISOR_PERIOD_MS,
+              "A flash erase stalls the supervisor, the watchdog must outlast it");
+static_assert(TEMP_FAULT_LIMIT > PROGRAM_MAX_TEMP * 10, "The fault limit must sit above every program's setpoint");
+static_assert(FAULT_REGISTER >= 10 && FAULT_REGISTER < 20, "The fault record needs its own backup register");
+static_assert(MODE_REGISTER > FAULT_REGISTER && MODE_REGISTER < 20, "The telemetry mode needs its own backup register");
+const char* const STATE_NAMES[NUM_SYSTEM_STATES] = {
+    "OFF", "ON", "IDLE", "DOOR_OPEN_FAULT", "OVERLOAD_FAULT", "RUNNING", "PAUSED", "PAUSED_DOOR_OPEN", "CALIBRATING",
+    "SAVING_SETTINGS"
+};
+const char* const COMMAND_STATUS_NAMES[NUM_COMMAND_STATUSES] = {
+    "ok", "refused", "unknown command", "bad arguments", "bad frame", "deferred"
+};
+
+// Latency statistics for one section, in CPU cycles
+struct TimingStats {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+    uint32_t histogram[TIMING_BUCKETS];   // Bucket n counts durations in [2^n, 2^(n+1))
+};
+
+// One sensor pass, published by the safety thread through the snapshot seqlock
+struct SensorSnapshot {
+    uint32_t time_ms;    // Kernel clock at the sample
+    int16_t rpm;         // Pot settings
+    int16_t temp;
+    int16_t time;
+    int16_t load;        // FSR load (‰)
+    int16_t light;       // LDR light level (0.1%)
+    int16_t tempActual;  // Drum temperature (0.1°C)
+    bool doorOpen;       // Debounced door state
+    bool overloaded;
+};
+
+// Display contents, posted by the control thread to the UI thread
+struct DisplayFrames {
+    uint8_t frames[DISPLAY_MAX_FRAMES];
+    uint8_t count;
+};
+
+// One cycle log record. Fixed size so the log is a ring of slots, and a
+// multiple of the flash program unit so records never share a page write.
+struct CycleRecord {
+    uint32_t seq;          // Record number, CYCLE_LOG_FREE in an erased slot
+    uint32_t uptime_s;     // Uptime at the end of the cycle
+    uint32_t duration_s;   // Real time the cycle ran, heat holds included, pauses not
+    uint16_t minutes;      // Planned cycle time (cycle minutes)
+    uint16_t rpm;          // Spin speed setting
+    uint16_t load;         // FSR load at start (‰)
+    uint8_t temp;          // Wash temperature setting (°C)
+    uint8_t loadClass;     // LoadClass at start
+    uint8_t outcome;       // CycleOutcome
+    uint8_t lastPhase;     // CyclePhase reached
+    uint8_t program;       // Wash program number, MANUAL_PROGRAM for the pots
+    uint8_t imbalances;    // Imbalances handled during the spin
+    uint16_t heatRate;     // Measured heat phase rate (m°C/s), 0 = not measured
+    uint16_t energy;       // Heater and motor energy (0.1 Wh)
+    uint8_t eco;           // Eco heating ran
+    uint8_t reserved;      // Zero, room for later fields
+    uint16_t checksum;     // Sum of the preceding bytes, torn writes fail it
+};
+static_assert(sizeof(CycleRecord) == 32, "CycleRecord must stay 32 bytes");
+
+// Sensor calibration, kept in the last bytes of the program table's flash sector
+struct SensorCalibration {
+    uint16_t magic;           // CALIBRATION_MAGIC
+    uint16_t doorThreshold;   // Light level (‰) above which the door is open
+    uint32_t tempFullScale;   // Drum temperature at ADC full scale (0.1°C)
+    uint8_t reserved[6];      // Zero, room for later fields
+    uint16_t checksum;        // Sum of the preceding bytes
+};
+static_assert(sizeof(SensorCalibration) == 16, "SensorCalibration must stay 16 bytes");
+
+// One timing section (TLM_TIMING), answers CMD_GET_STATS in binary mode
+struct TimingFrame {
+    uint8_t type;       // TLM_TIMING
+    uint8_t section;    // TimingSection
+    uint16_t reserved;
+    uint32_t count;     // Cycles, as in the text report
+    uint32_t min;
+    uint32_t max;
+    uint32_t mean;
+};
+static_assert(sizeof(TimingFrame) <= TELEMETRY_MAX_PAYLOAD, "TimingFrame must fit a frame");
+
+// One cycle log record (TLM_LOG_RECORD), answers CMD_GET_LOG in binary mode
+struct LogRecordFrame {
+    uint8_t type;       // TLM_LOG_RECORD
+    uint8_t reserved[3];
+    CycleRecord record;
+};
+static_assert(sizeof(LogRecordFrame) <= TELEMETRY_MAX_PAYLOAD, "LogRecordFrame must fit a frame");
+
+// Binary command frame being received: SYNC, length, payload (code and
+// arguments), checksum, the same framing as the telemetry
+struct CommandParser {
+    CommandParseState state;
+    uint8_t length;
+    uint8_t received;
+    uint8_t sum;
+    uint8_t payload[COMMAND_MAX_PAYLOAD];
+};
+
+// A fixed slice of the static arena. Queues fill their buffer from the
+// bottom, so the arena fill still at the top is their headroom; stacks are
+// measured by the RTOS instead.
+struct PoolSpec {
+    const char* name;
+    uint32_t size;         // Bytes, multiple of 8 (stack alignment)
+};
+
+// Sized at compile time; shrink from the high-water marks in the 'm' report
+constexpr PoolSpec POOLS[NUM_MEMORY_POOLS] = {
+    {"safety_queue",    16 * EVENTS_EVENT_SIZE},
+    {"control_queue",   32 * EVENTS_EVENT_SIZE},
+    {"ui_queue",        32 * EVENTS_EVENT_SIZE},
+    {"telemetry_queue", 8 * EVENTS_EVENT_SIZE},
+    {"safety_stack",    OS_STACK_SIZE},
+    {"ui_stack",        OS_STACK_SIZE},
+    {"telemetry_stack", OS_STACK_SIZE}
+};
+
+// Start of a pool in the arena, NUM_MEMORY_POOLS gives the arena size
+constexpr uint32_t poolOffset(int pool) {
+    uint32_t offset = 0;
+    for (int i = 0; i < pool; i++) {
+        offset += POOLS[i].size;
+    }
+    return offset;
+}
+
+constexpr bool poolsAligned() {
+    for (int i = 0; i < NUM_MEMORY_POOLS; i++) {
+        if (POOLS[i].size == 0 || POOLS[i].size % 8 != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const uint32_t ARENA_SIZE = poolOffset(NUM_MEMORY_POOLS);
+static_assert(poolsAligned(), "Memory pools must be non-empty multiples of 8 bytes");
+
+// Cycle engine state saved every tick, enough to rebuild the cycle
+struct CycleCheckpoint {
+    uint16_t seq;          // Newest slot wins
+    uint16_t rpm;          // Settings at start
+    uint8_t minutes;
+    uint8_t temp;
+    uint16_t load;         // FSR load at start, selects the plan
+    uint8_t phase;         // Phase at the checkpoint (informational, elapsed decides)
+    uint8_t program;       // Wash program, MANUAL_PROGRAM for the pots
+    uint32_t elapsedMs;    // Cycle time run so far
+};
+
+// Single-bin DFT, fed one sample at a time
+struct Goertzel {
+    int32_t coeff;   // 2cos(2π f / fs), Q16
+    int32_t s1;      // Last two filter outputs
+    int32_t s2;
+};
+
+// PID loop state, integer arithmetic so it runs in the timer ISR
+struct PidController {
+    int32_t kp;             // Gains (Q8, ‰ duty per unit error)
+    int32_t ki;             // Integral gain per loop tick
+    int32_t kd;             // Derivative gain per loop tick, on the measurement
+    int32_t integral;       // Integral term (Q8 ‰ duty), clamped to the output range
+    int32_t prevMeasured;   // Last measurement for the derivative
+};
+
+// One debounced active-low input, sampled every 1 ms by buttonTicker.
+// history is a shift register of raw samples (newest in bit 0), the state
+// flips only once every sample under BUTTON_STABLE_MASK agrees.
+struct DebouncedInput {
+    ButtonId id;
+    mbed::Callback<int()> read;   // Raw level, 0 = pressed
+    uint8_t history;
+    bool pressed;                 // Debounced state
+    bool longSent;                // Long press already reported for this press
+    uint32_t heldMs;              // Time held in the current press
+};
 
-// Load level thresholds
-const float LOAD_LIGHT = 0.2f;            // Light load
-const float LOAD_MEDIUM = 0.4f;           // Medium load
-const float LOAD_HEAVY = 0.6f;            // Heavy load
-const float LOAD_OVERLOAD = 0.7f;         // Overload condition
+// One queued buzzer tone
+struct BeepStep {
+    float freq;       // Tone frequency (Hz)
+    int duration_ms;  // Tone length
+    int gap_ms;       // Silence after the tone
+};
 
 // Inputs
 AnalogIn potRPM(PA_7);      // RPM Pot
@@ -34,8 +745,13 @@ AnalogIn fsrSensor(PA_1);   // FSR
 AnalogIn tempSensor(PC_3);  // Temp sensor
 AnalogIn ldrSensor(PC_2);   // LDR
 
-DigitalIn powerButton(PC_10);        // Power button
-DigitalIn startPauseButton(PC_11);   // Run Cycle button
+// ADC scan sequence (indexed by AdcChannel)
+AnalogIn* const adcChannels[NUM_ADC_CHANNELS] = {
+    &potRPM, &potTemp, &potTime, &fsrSensor, &tempSensor, &ldrSensor
+};
+
+InterruptIn powerButton(PC_10);        // Power button (also the standby wake source)
+DigitalIn startPauseButton(PC_11);     // Run Cycle button
 
 // Outputs
 BusOut segDis(PA_11, PA_12, PB_1, PB_14, PB_15, PB_12, PB_11);  // 7 segment display
@@ -43,24 +759,129 @@ PwmOut buzzer(PA_15);       // Buzzer
 PwmOut rgbRed(PB_3);        // RGB LED (Red)
 PwmOut rgbGreen(PB_4);      // RGB LED (Green)
 PwmOut rgbBlue(PB_5);       // RGB LED (Blue)
+PwmOut heater(PA_8);        // Heater drive (TIM1)
+PwmOut motor(PB_6);         // Drum motor drive (TIM4)
 DigitalOut redLED(PC_0);    // Door Open Led (Red LED)
 
+// Buzzer sequencer timer
+Timeout buzzerTimeout;
+
+// Internal flash, for the cycle log
+FlashIAP flash;
+
+// Fixed-rate PID timer
+Ticker pidTicker;
+
+// Watchdog supervisor, keeps running in standby (LSE/LSI clocked)
+LowPowerTicker supervisorTicker;
+
+// Button sampler and the debounced inputs it runs
+Ticker buttonTicker;
+DebouncedInput buttons[NUM_BUTTONS] = {
+    {BUTTON_POWER, callback(&powerButton, &InterruptIn::read), 0xFF, false, false, 0},
+    {BUTTON_START, callback(&startPauseButton, &DigitalIn::read), 0xFF, false, false, 0}
+};
+volatile bool buttonsSampling = false;
+volatile bool buttonWakePending = false;  // Sampling restarted by a standby wake edge, no press seen yet
+uint32_t buttonWakeMs = 0;
+
+// Static arena for every event queue buffer and thread stack, which Mbed
+// would otherwise take from the heap. Declared ahead of the queues and
+// threads so it is filled before they are constructed.
+struct StaticArena {
+    alignas(8) uint8_t data[ARENA_SIZE];
+    StaticArena() {
+        for (uint32_t i = 0; i < ARENA_SIZE; i += 4) {
+            memcpy(&data[i], &ARENA_FILL, 4);
+        }
+    }
+    uint8_t* pool(MemoryPool p) { return &data[poolOffset(p)]; }
+};
+StaticArena arena;
+
+// One event queue per thread, posting a call to a queue is the message
+// passing between threads. Priorities from highest: safety, control, UI, telemetry.
+
+// Safety thread: ADC sampling, door and overload detection
+EventQueue safetyQueue(POOLS[POOL_SAFETY_QUEUE].size, arena.pool(POOL_SAFETY_QUEUE));
+Thread safetyThread(osPriorityHigh, POOLS[POOL_SAFETY_STACK].size, arena.pool(POOL_SAFETY_STACK), "safety");
+
+// Control thread (main(), osPriorityNormal): buttons, system state, cycle engine
+EventQueue controlQueue(POOLS[POOL_CONTROL_QUEUE].size, arena.pool(POOL_CONTROL_QUEUE));
+
+// UI thread: display, RGB LED, door LED and buzzer
+EventQueue uiQueue(POOLS[POOL_UI_QUEUE].size, arena.pool(POOL_UI_QUEUE));
+Thread uiThread(osPriorityBelowNormal, POOLS[POOL_UI_STACK].size, arena.pool(POOL_UI_STACK), "ui");
+
+// Serial port (also the console) and the low priority thread draining telemetry
+BufferedSerial serialPort(USBTX, USBRX, SERIAL_BAUD);
+EventQueue telemetryQueue(POOLS[POOL_TELEMETRY_QUEUE].size, arena.pool(POOL_TELEMETRY_QUEUE));
+Thread telemetryThread(osPriorityLow, POOLS[POOL_TELEMETRY_STACK].size, arena.pool(POOL_TELEMETRY_STACK), "telemetry");
+
+// Threads owning the stack pools, for their stack high-water marks
+Thread* const POOL_THREADS[NUM_MEMORY_POOLS] = {
+    nullptr, nullptr, nullptr, nullptr, &safetyThread, &uiThread, &telemetryThread
+};
+
+// Heap guard: nothing may allocate once main() has started the threads.
+// Needs Mbed heap stats (platform.heap-stats-enabled) to see malloc().
+uint32_t heapLockBytes = 0;               // Bytes ever allocated when the heap was locked
+uint32_t heapReportedBytes = 0;           // Bytes after boot already logged
+
 // 7 Segment Digits
 const int hexDis[] = {0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07, 0x7F, 0x6F, 0x77, 0x7C, 0x39, 0x5E, 0x79, 0x71};
+const uint8_t SEG_BLANK = 0x00;           // All segments off
+const uint8_t SEG_DASH = 0x40;            // Middle segment, field separator
+const uint8_t SEG_P = 0x73;               // Letter P, program number prefix
+const uint8_t SEG_C = 0x39;               // Letter C, calibration step prefix
 
-// Global Variables
+// Control thread state
 SystemState systemState = OFF;
+SensorSnapshot lastReading = {};          // Snapshot the control thread last acted on, time_ms 0 = none yet
+
+// Latest sensor snapshot: one writer (safety thread), readers anywhere.
+// The sequence is odd while a write is in progress.
+SensorSnapshot snapshotData = {};
+std::atomic<uint32_t> snapshotSeq(0);
+std::atomic<bool> sensorReportPending(false);
+
+// Safety thread detection state
 bool doorOpenWarningActive = false;
 bool overloadWarningActive = false;
 
-// Button debouncing (to make sure system starts in off state)
-int lastPowerState = 0;
-int lastStartState = 0;
+// Display framebuffer (UI thread): segment codes shown one after another on the digit
+bool uiPowered = false;
+uint8_t displayFrames[DISPLAY_MAX_FRAMES];
+int displayFrameCount = 0;
+int displayFrameIndex = 0;
+int displayTick = 0;
+
+// Telemetry ring: any thread produces (under a critical section), the telemetry thread consumes
+TelemetryFrame telemetryRing[TELEMETRY_QUEUE_SIZE];
+std::atomic<uint32_t> telemetryHead(0);   // Next frame to send (consumer)
+std::atomic<uint32_t> telemetryTail(0);   // Next free slot (producer)
+std::atomic<bool> telemetryDrainPending(false);
+uint16_t telemetrySeq = 0;
+std::atomic<bool> telemetryBinary(TELEMETRY_BINARY);   // Switched by CMD_SET_MODE
+
+// Serial command input (control thread)
+CommandParser commandParser = {PARSE_TEXT, 0, 0, 0, {}};
+
+// Section timing (each section from one thread), and the copy printed by the telemetry thread
+TimingStats timingStats[NUM_TIMING_SECTIONS];
+TimingStats timingReport[NUM_TIMING_SECTIONS];
+uint32_t lastTickStart = 0;
+std::atomic<bool> serialInputPending(false);
+
+// Standby (OFF state) and the periodic events it cancels
+bool standbyActive = false;
+int safetyEventId = 0;
+int displayEventId = 0;
 
 // Previous readings for to detect significant change
-float prevFsr = -1.0f;
-float prevLdr = -1.0f; 
-float prevTempActual = -1.0f;
+int prevFsr = -1;
+int prevLdr = -1; 
+int prevTempActual = -1;
 int prevRpm = -1;
 int prevTemp = -1;
 int prevTime = -1;
@@ -69,20 +890,500 @@ int prevTime = -1;
 int doorOpenCount = 0;
 int doorClosedCount = 0;
 
+// ADC scan ring buffer (last NUM_SAMPLES scans of every channel)
+uint16_t adcRing[NUM_ADC_CHANNELS][NUM_SAMPLES];
+int adcHead = 0;
+int adcCount = 0;
+
+// Low-pass filter state per channel (raw << FILTER_FRAC_BITS)
+int32_t filterState[NUM_ADC_CHANNELS];
+
+// Buzzer tone queue (filled by queueBeep(), drained by the buzzerTimeout ISR)
+BeepStep beepQueue[BEEP_QUEUE_SIZE];
+volatile int beepHead = 0;
+volatile int beepTail = 0;
+volatile bool buzzerBusy = false;
+int beepGapMs = 0;
+
+// Wash cycle engine
+CyclePhase cyclePhase = PHASE_FILL;
+Kernel::Clock::time_point cycleStartTime;
+Kernel::Clock::time_point phaseStartTime;   // Real time, for the spin ramp
+Kernel::Clock::time_point pauseTime;
+int pausedElapsedMs = 0;         // Cycle clock while PAUSED
+int cycleTotalMs = 0;
+int phaseEndMs[NUM_PHASES];      // Phase end times from cycle start
+ProgramPhase cycleSteps[NUM_PHASES];   // Actuators per phase (durations are in phaseEndMs)
+int cycleProgram = MANUAL_PROGRAM;
+
+// Remaining time estimator: heating is measured from the heat phase start,
+// the prior rates come from the cycle log at boot
+Kernel::Clock::time_point heatStartTime;  // Real time, excluding pauses
+int heatStartTemp = 0;                    // Drum temperature at the heat phase start (0.1°C)
+int heatHoldMs = 0;                       // Cycle clock held waiting for the drum to warm
+bool heatHolding = false;
+int cycleHeatRate = 0;                    // Measured rate of this cycle's heat phase (m°C/s)
+int heatRatePrior[NUM_LOAD_CLASSES];
+bool ecoHeating = false;                  // Eco heating for the next cycle (CMD_SET_ECO)
+bool cycleEco = false;                    // Eco heating in the running cycle
+
+// Wash programs: the table in use, read in place by the control and
+// telemetry threads. An upload is staged in RAM, then written to the flash
+// sector below the cycle log by the telemetry thread.
+std::atomic<const ProgramTable*> programTable(&BUILTIN_PROGRAMS);
+uint32_t programTableAddr = 0;            // Flash copy of an uploaded table, 0 = no flash
+int selectedProgram = MANUAL_PROGRAM;     // Program the start button runs (control thread)
+ProgramTable programUpload;               // Table being received over serial
+int programUploadNibbles = UPLOAD_IDLE;   // Hex digits received, or an UPLOAD_ state
+std::atomic<bool> programWriteBusy(false);
+int lastCountdownStep = -1;
+
+// Sensor calibration: the values in use are read by the safety thread, the
+// steps run on the control thread
+std::atomic<int> doorOpenThreshold(DOOR_OPEN_THRESHOLD);
+std::atomic<uint32_t> tempFullScale(TEMP_FULL_SCALE);
+SensorCalibration calibration = {};       // Record to keep in flash, magic 0 = never calibrated
+int calibrationStep = 0;                  // CAL_ step being prompted
+int calibrationSamples = -1;              // Reports averaged so far, -1 = waiting for start
+int32_t calibrationSum = 0;
+int calibrationClosedLight = 0;           // Averaged door light levels (‰)
+int calibrationOpenLight = 0;
+int calibrationRefC = 0;                  // Reference temperature entered, 0 = keep the gain
+uint32_t calibrationFullScale = 0;        // Fitted temperature gain
+
+// Cycle log: append-only ring of CycleRecords in the last CYCLE_LOG_SECTORS
+// flash sectors. The control thread queues records, the telemetry thread
+// programs them in batches and only while no cycle runs (a flash write stalls
+// the CPU on single bank parts).
+uint32_t cycleLogStart = 0;               // Region bounds, 0 = no log
+uint32_t cycleLogEnd = 0;
+uint32_t cycleLogHead = 0;                // Next free slot (telemetry thread)
+uint32_t cycleLogSeq = 0;                 // Sequence number of the next record
+CycleRecord cycleLogPending[CYCLE_LOG_BATCH];   // Queued records, under a critical section
+int cycleLogPendingCount = 0;
+std::atomic<bool> cycleLogFlushAllowed(true);
+std::atomic<bool> cycleLogFlushPending(false);
+
+// PID control (setpoints written by the control thread, loops run in the pidTicker ISR)
+std::atomic<int32_t> heaterSetpoint(0);   // Drum temperature (0.1°C), 0 = heater off
+std::atomic<int32_t> motorSetpoint(0);    // Drum speed (RPM), 0 = motor off
+std::atomic<int32_t> heaterDutyLimit(PID_OUTPUT_MAX);   // Heater output cap (‰), eco heating
+PidController heaterPid = {2560, 26, 0, 0, 0};   // Kp 10 ‰/0.1°C, Ki 0.1 per tick
+PidController motorPid = {256, 3, 0, 0, 0};      // Kp 1 ‰/RPM, Ki 0.012 per tick
+int32_t motorRpmQ8 = 0;                   // Modelled drum speed (RPM, Q8)
+int32_t heaterMeasured = 0;               // Last consistent drum temperature
+int heaterDivider = 0;
+
+// Watchdog supervision: tasks count their check-ins, the supervisor ISR
+// watches the counts of the tasks that are running
+std::atomic<uint32_t> taskCheckIns[NUM_SUPERVISED_TASKS];
+std::atomic<bool> taskSupervised[NUM_SUPERVISED_TASKS];
+uint32_t taskSeenCheckIns[NUM_SUPERVISED_TASKS];   // Supervisor ISR only
+int taskQuietMs[NUM_SUPERVISED_TASKS];
+std::atomic<bool> supervisionHeld(false);   // Flash erase in progress, the CPU stalls
+bool watchdogStarved = false;               // A deadline was missed, reset pending
+
+// Fault manager: the latched cause keeps the PID outputs off until the
+// control thread has ended the cycle
+std::atomic<uint8_t> activeFault(FAULT_NONE);
+
+// Energy meter: whole joules for the control thread, the ISR keeps the
+// fraction (µJ)
+std::atomic<uint32_t> heaterEnergyJ(0);
+std::atomic<uint32_t> motorEnergyJ(0);
+uint32_t heaterEnergyUj = 0;
+uint32_t motorEnergyUj = 0;
+uint32_t cycleHeaterStartJ = 0;           // Meter readings at the cycle start
+uint32_t cycleMotorStartJ = 0;
+int cycleRpm = 0;                         // Settings of the running cycle
+int cycleTemp = 0;
+int cycleMinutes = 0;
+int cycleLoad = 0;
+int spinRedistributions = 0;              // Redistribution passes this cycle
+int spinRpmLimit = 0;                     // Reduced spin speed, 0 = none
+int imbalanceRpm = 0;                     // Drum speed of the latest imbalance report
+
+// Drum vibration capture (safety thread)
+int vibrationEventId = 0;
+Goertzel vibrationFilter;
+int vibrationRpm = 0;                     // Drum setpoint the block is tuned to
+int vibrationSamples = 0;
+int32_t vibrationSum = 0;                 // Sample sum of the block, its mean is the next block's DC
+int32_t vibrationMean = -1;               // DC taken off each sample, -1 before the first block
+int vibrationHits = 0;                    // Consecutive blocks over the threshold
+bool vibrationReported = false;           // One report per capture
+
+// Power-loss checkpoints in the RTC backup registers (control thread).
+// They keep their contents over resets and, with a cell on VBAT, a mains loss.
+uint16_t checkpointSeq = 0;
+bool checkpointSlotFresh[CHECKPOINT_SLOTS];   // Slot already holds this cycle's settings
+CycleCheckpoint resumeCheckpoint;             // Interrupted cycle found at boot
+bool resumeAvailable = false;
+
 // Functions
 void setRGB(float r, float g, float b);
-void playBeep(float freq, int duration_ms);
-void setLoadLevelColor(float load);
-void runCycleCountdown(int minutes);
-bool hasSignificantChange(float newVal, float prevVal, float threshold);
+void playBeep(float freq, int duration_ms, int gap_ms = 0);
+void queueBeep(float freq, int duration_ms, int gap_ms);
+void startNextBeep();
+void endBeep();
+void setLoadLevelColor(int load);
+LoadClass classifyLoad(int load);
+const CyclePlan& planCycle(LoadClass loadClass, int temp);
+void setDoorLed(bool on);
+void planManualCycle(int minutes, int rpm, int temp, int load);
+void planProgramCycle(int number, int load);
+void beginCycle(int resumeMs);
+int programCount();
+const WashProgram& programAt(int number);
+int programCycleMs(const WashProgram& program);
+uint32_t programTableChecksum(const ProgramTable& table);
+bool programTableValid(const ProgramTable& table);
+void initProgramTable();
+void printPrograms();
+void receiveProgramUpload(char c);
+void finishProgramUpload();
+void writeSettingsSector(bool calibration);
+void onProgramTableWritten(bool ok);
+void initCalibration();
+bool calibrationValid(const SensorCalibration& cal);
+uint16_t calibrationChecksum(const SensorCalibration& cal);
+void applyCalibration(const SensorCalibration& cal);
+uint32_t calibrationAddr();
+void saveCalibration(const SensorCalibration& cal);
+void onCalibrationWritten(bool ok);
+int planCycleMs(int minutes, const CyclePlan& plan);
+void initCheckpoint();
+void startWatchdog();
+void superviseTasks();
+void checkIn(SupervisedTask task);
+void superviseTask(SupervisedTask task, bool supervised);
+bool enterSafeState(FaultCause cause, int detail);
+void checkOutputFaults(int tempActual);
+void onFault(int cause);
+MachineEvent abortFault();
+void reportFaultRecord();
+void setTelemetryMode(bool binary);
+void initTelemetryMode();
+void writeCheckpoint();
+bool readCheckpointSlot(int slot, CycleCheckpoint& out);
+void clearCheckpoint();
+int checkpointRemainingMs(const CycleCheckpoint& cp);
+void applyPhaseSetpoints();
+void setPidSetpoints(int temp, int rpm);
+void startPid();
+void stopPid();
+void pidTick();
+void goertzelInit(Goertzel& g, int rpm);
+void goertzelStep(Goertzel& g, int32_t sample);
+int64_t goertzelPower(const Goertzel& g);
+void watchVibration();
+void startVibrationBlock(int rpm);
+void sampleVibration();
+void onImbalance(int rpm);
+int32_t pidUpdate(PidController& pid, int32_t setpoint, int32_t measured, int32_t outputMax = PID_OUTPUT_MAX);
+void meterEnergy(std::atomic<uint32_t>& joules, uint32_t& microjoules, int32_t duty, int powerW, int periodUs);
+void pidReset(PidController& pid, int32_t measured);
+int cycleElapsedMs();
+void startHeatMeasurement();
+int measuredHeatRate();
+int heatRateEstimate();
+int estimateRemainingMs(int elapsed);
+bool holdForHeating(int& elapsed);
+int32_t ecoHeaterLimit(int elapsed);
+void loadHeatHistory();
+template<typename F> void forEachCycleRecord(F visit);
+void abortCycle(LogEvent reason, CycleOutcome outcome);
+void initCycleLog();
+uint32_t readRecordSeq(uint32_t addr);
+void recordCycle(CycleOutcome outcome);
+void recordCheckpointCycle(const CycleCheckpoint& cp, CycleOutcome outcome);
+void queueCycleRecord(const CycleRecord& record);
+void requestCycleLogFlush();
+void flushCycleLog();
+uint16_t cycleRecordChecksum(const CycleRecord& record);
+void printCycleLog();
+uint32_t poolHighWater(MemoryPool pool);
+uint32_t heapAllocatedBytes();
+void lockHeap();
+void checkHeap();
+void printMemoryReport();
+void pushTelemetry(TelemetryFrame& frame);
+void logEvent(LogEvent code, int a = 0, int b = 0, int c = 0);
+void logSettings(int rpm, int temp, int time);
+void logSensors(int load, int temp, int light, bool doorOpen);
+void drainTelemetry();
+void printTelemetryFrame(const TelemetryFrame& frame);
+void sendTelemetryFrame(const TelemetryFrame& frame);
+void sendFrame(const void* payload, int length);
+void logStatus();
+void logReply(CommandCode code, CommandStatus status, int count = 0);
+bool hasSignificantChange(int newVal, int prevVal, int threshold);
 void readAndProcessSensors();
-void handleButtons();
-void updateDisplay(int value);
-bool isDoorOpen(float ldr);
-bool isOverloaded(float load);
-void powerOn();
-void powerOff();
-float readAveragedSensor(AnalogIn& sensor, float scale = 1.0f);
+void startButtonSampling();
+void stopButtonSampling();
+void powerButtonWake();
+void sampleButtons();
+void sampleInput(DebouncedInput& input);
+void onButtonEvent(ButtonId id, ButtonEvent event, uint32_t heldMs);
+void safetyTick();
+void resetSensing();
+void onSensorReading();
+void publishSnapshot(const SensorSnapshot& snapshot);
+bool tryReadSnapshot(SensorSnapshot& out);
+void readSnapshot(SensorSnapshot& out);
+void refreshDisplay();
+void startPeriodicEvents();
+void stopPeriodicEvents();
+void enterStandby();
+void exitStandby();
+void uiPowerOn();
+void uiPowerOff();
+void postDisplayFrames(const uint8_t* frames, int count);
+void setDisplayFrames(DisplayFrames frames);
+void clearDisplay();
+void showTimeRemaining(int seconds);
+void showSettings(int time, int rpm, int temp);
+void showProgram(int number, int minutes);
+bool isDoorOpen(int ldr);
+bool debounceDoor(bool reading);
+bool isOverloaded(int load);
+void resetAdcScan();
+void scanAdcChannels();
+uint16_t medianOfRecent(int channel, int taps);
+uint16_t readAdcRaw(AdcChannel channel);
+int scaleRaw(uint16_t raw, uint32_t fullScale);
+int potToRpm(uint16_t raw);
+int potToTemp(uint16_t raw);
+int potToTime(uint16_t raw);
+void initCycleCounter();
+uint32_t readCycleCounter();
+void recordTiming(TimingSection section, uint32_t cycles);
+void resetTimingStats();
+void snapshotTimingStats();
+void printTimingReport();
+void serialSigio();
+void handleSerialInput();
+void receiveCommandByte(uint8_t c);
+void runTextCommand(char c);
+CommandStatus runCommand(uint8_t code, const uint8_t* args, int argCount);
+void sendTimingReport();
+void sendCycleLog(int count);
+void runBenchmarks();
+
+// State machine actions: run by dispatchEvent() on a transition, they may
+// return a completion event that is dispatched right after it
+void dispatchEvent(MachineEvent event);
+bool inState(SystemState state);
+MachineEvent powerOn();
+MachineEvent powerOff();
+MachineEvent powerOffMidCycle();
+MachineEvent startOrResumeCycle();
+MachineEvent resumeCycle();
+MachineEvent refuseStartDoorOpen();
+MachineEvent refuseStartOverload();
+MachineEvent refuseStartSaving();
+MachineEvent refuseResumeDoorOpen();
+MachineEvent pauseCycle();
+MachineEvent unpauseCycle();
+MachineEvent cancelCycle();
+MachineEvent abortDoorOpen();
+MachineEvent updateCycle();
+MachineEvent advancePhase();
+MachineEvent rebalanceSpin();
+MachineEvent finishCycle();
+MachineEvent checkStartInhibit();
+MachineEvent doorOpenedBeep();
+MachineEvent warnOverload();
+MachineEvent reportLoadOk();
+MachineEvent clearOverload();
+MachineEvent showIdleStatus();
+MachineEvent showPausedStatus();
+MachineEvent selectNextProgram();
+void selectProgram(int number);
+MachineEvent startCalibration();
+MachineEvent sampleCalibration();
+MachineEvent updateCalibration();
+MachineEvent cancelCalibration();
+MachineEvent finishCalibration();
+void showCalibrationStep();
+
+typedef MachineEvent (*TransitionAction)();
+
+// Nesting: a state without a row for an event takes its parent's
+struct StateInfo {
+    SystemState state;
+    SystemState parent;
+    bool abstract;        // Superstate only, never current
+};
+
+// An absent next state, and the next state of an internal transition
+const SystemState NO_STATE = NUM_SYSTEM_STATES;
+const SystemState STAY = (SystemState)(NUM_SYSTEM_STATES + 1);
+
+constexpr StateInfo STATE_INFO[NUM_SYSTEM_STATES] = {
+    {OFF,              NO_STATE, false},
+    {ON,               NO_STATE, true},
+    {IDLE,             ON,       false},
+    {DOOR_OPEN_FAULT,  IDLE,     false},
+    {OVERLOAD_FAULT,   IDLE,     false},
+    {RUNNING,          ON,       false},
+    {PAUSED,           ON,       false},
+    {PAUSED_DOOR_OPEN, PAUSED,   false},
+    {CALIBRATING,      ON,       false},
+    {SAVING_SETTINGS,  IDLE,     false}
+};
+
+struct Transition {
+    SystemState state;
+    MachineEvent event;
+    TransitionAction action;   // nullptr for none
+    SystemState next;
+};
+
+// Every transition of the washer. The door outranks the load: an open door
+// holds DOOR_OPEN_FAULT whatever the load does, and leaving a fault goes
+// through IDLE, which checks the start conditions again.
+constexpr Transition TRANSITIONS[] = {
+    {OFF,              EV_POWER,            powerOn,              IDLE},
+    
+    {ON,               EV_POWER,            powerOff,             OFF},
+    {ON,               EV_OVERLOAD,         warnOverload,         STAY},
+    {ON,               EV_LOAD_OK,          reportLoadOk,         STAY},
+    
+    {IDLE,             EV_START,            startOrResumeCycle,   STAY},
+    {IDLE,             EV_CYCLE_STARTED,    nullptr,              RUNNING},
+    {IDLE,             EV_LONG_PRESS,       selectNextProgram,    STAY},
+    {IDLE,             EV_DOOR_OPENED,      doorOpenedBeep,       DOOR_OPEN_FAULT},
+    {IDLE,             EV_DOOR_STILL_OPEN,  nullptr,              DOOR_OPEN_FAULT},
+    {IDLE,             EV_OVERLOAD,         warnOverload,         OVERLOAD_FAULT},
+    {IDLE,             EV_STILL_OVERLOADED, nullptr,              OVERLOAD_FAULT},
+    {IDLE,             EV_STILL_SAVING,     nullptr,              SAVING_SETTINGS},
+    {IDLE,             EV_SENSOR_REPORT,    showIdleStatus,       STAY},
+    {IDLE,             EV_CALIBRATE,        startCalibration,     CALIBRATING},
+    
+    {DOOR_OPEN_FAULT,  EV_START,            refuseStartDoorOpen,  STAY},
+    {DOOR_OPEN_FAULT,  EV_DOOR_CLOSED,      checkStartInhibit,    IDLE},
+    {DOOR_OPEN_FAULT,  EV_OVERLOAD,         warnOverload,         STAY},
+    
+    {OVERLOAD_FAULT,   EV_START,            refuseStartOverload,  STAY},
+    {OVERLOAD_FAULT,   EV_LOAD_OK,          clearOverload,        IDLE},
+    
+    {SAVING_SETTINGS,  EV_START,            refuseStartSaving,    STAY},
+    {SAVING_SETTINGS,  EV_LONG_PRESS,       nullptr,              STAY},
+    {SAVING_SETTINGS,  EV_CALIBRATE,        nullptr,              STAY},
+    {SAVING_SETTINGS,  EV_SETTINGS_SAVED,   checkStartInhibit,    IDLE},
+    
+    {RUNNING,          EV_POWER,            powerOffMidCycle,     OFF},
+    {RUNNING,          EV_START,            pauseCycle,           PAUSED},
+    {RUNNING,          EV_LONG_PRESS,       cancelCycle,          IDLE},
+    {RUNNING,          EV_DOOR_OPENED,      abortDoorOpen,        DOOR_OPEN_FAULT},
+    {RUNNING,          EV_SENSOR_REPORT,    updateCycle,          STAY},
+    {RUNNING,          EV_PHASE_END,        advancePhase,         STAY},
+    {RUNNING,          EV_IMBALANCE,        rebalanceSpin,        STAY},
+    {RUNNING,          EV_CYCLE_END,        finishCycle,          IDLE},
+    {RUNNING,          EV_FAULT,            abortFault,           IDLE},
+    
+    {PAUSED,           EV_POWER,            powerOffMidCycle,     OFF},
+    {PAUSED,           EV_START,            unpauseCycle,         RUNNING},
+    {PAUSED,           EV_LONG_PRESS,       cancelCycle,          IDLE},
+    {PAUSED,           EV_DOOR_OPENED,      doorOpenedBeep,       PAUSED_DOOR_OPEN},
+    {PAUSED,           EV_SENSOR_REPORT,    showPausedStatus,     STAY},
+    {PAUSED,           EV_FAULT,            abortFault,           IDLE},
+    
+    {PAUSED_DOOR_OPEN, EV_START,            refuseResumeDoorOpen, STAY},
+    {PAUSED_DOOR_OPEN, EV_DOOR_CLOSED,      nullptr,              PAUSED},
+    
+    {CALIBRATING,      EV_START,            sampleCalibration,    STAY},
+    {CALIBRATING,      EV_LONG_PRESS,       cancelCalibration,    IDLE},
+    {CALIBRATING,      EV_SENSOR_REPORT,    updateCalibration,    STAY},
+    {CALIBRATING,      EV_CALIBRATION_DONE, finishCalibration,    IDLE}
+};
+const int NUM_TRANSITIONS = sizeof(TRANSITIONS) / sizeof(TRANSITIONS[0]);
+
+// Row for an event in a state or its nearest ancestor, -1 if none
+constexpr int findTransition(SystemState state, MachineEvent event) {
+    for (SystemState s = state; s != NO_STATE; s = STATE_INFO[s].parent) {
+        for (int i = 0; i < NUM_TRANSITIONS; i++) {
+            if (TRANSITIONS[i].state == s && TRANSITIONS[i].event == event) {
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
+// TRANSITIONS flattened into a state × event lookup, built at compile time
+struct TransitionTable {
+    TransitionAction action[NUM_SYSTEM_STATES][NUM_MACHINE_EVENTS];
+    SystemState next[NUM_SYSTEM_STATES][NUM_MACHINE_EVENTS];   // NO_STATE: event ignored
+    constexpr TransitionTable() : action(), next() {
+        for (int s = 0; s < NUM_SYSTEM_STATES; s++) {
+            for (int e = 0; e < NUM_MACHINE_EVENTS; e++) {
+                int i = findTransition((SystemState)s, (MachineEvent)e);
+                action[s][e] = i < 0 ? nullptr : TRANSITIONS[i].action;
+                next[s][e] = i < 0 ? NO_STATE : TRANSITIONS[i].next;
+            }
+        }
+    }
+};
+
+constexpr TransitionTable TRANSITION_TABLE;
+
+// States are listed in enum order, nest without loops and only nest in superstates
+constexpr bool statesWellFormed() {
+    for (int s = 0; s < NUM_SYSTEM_STATES; s++) {
+        if (STATE_INFO[s].state != s) {
+            return false;
+        }
+        int depth = 0;
+        for (SystemState p = STATE_INFO[s].parent; p != NO_STATE; p = STATE_INFO[p].parent) {
+            if (++depth >= NUM_SYSTEM_STATES) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// One row per state and event, never into a superstate, events from EV_POWER on
+constexpr bool transitionsWellFormed() {
+    for (int i = 0; i < NUM_TRANSITIONS; i++) {
+        const Transition& t = TRANSITIONS[i];
+        if (t.event == EV_NONE || t.next == NO_STATE || (t.next != STAY && STATE_INFO[t.next].abstract)) {
+            return false;
+        }
+        for (int j = i + 1; j < NUM_TRANSITIONS; j++) {
+            if (TRANSITIONS[j].state == t.state && TRANSITIONS[j].event == t.event) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Power always works, and an open door always stops the drum
+constexpr bool safetyTransitionsPresent() {
+    for (int s = 0; s < NUM_SYSTEM_STATES; s++) {
+        if (!STATE_INFO[s].abstract && TRANSITION_TABLE.next[s][EV_POWER] == NO_STATE) {
+            return false;
+        }
+    }
+    return TRANSITION_TABLE.next[RUNNING][EV_DOOR_OPENED] == DOOR_OPEN_FAULT &&
+           TRANSITION_TABLE.next[PAUSED][EV_DOOR_OPENED] == PAUSED_DOOR_OPEN;
+}
+
+static_assert(statesWellFormed(), "STATE_INFO must follow SystemState and nest without loops");
+static_assert(transitionsWellFormed(), "TRANSITIONS has a duplicate row or targets a superstate");
+static_assert(safetyTransitionsPresent(), "Power or door transitions missing from TRANSITIONS");
+
+// Times the enclosing scope into a section
+struct ScopedTiming {
+    TimingSection section;
+    uint32_t start;
+    
+    ScopedTiming(TimingSection s) : section(s), start(readCycleCounter()) {}
+    ~ScopedTiming() { recordTiming(section, readCycleCounter() - start); }
+};
 
 // Set RGB LED colours
 void setRGB(float r, float g, float b) {
@@ -91,288 +1392,2935 @@ void setRGB(float r, float g, float b) {
     rgbBlue.write(b);
 }
 
-// Play a beep sound
-void playBeep(float freq, int duration_ms) {
-    buzzer.period(1.0f / freq);
+// Queue a beep sound on the UI thread (returns immediately, plays in the background)
+void playBeep(float freq, int duration_ms, int gap_ms) {
+    uiQueue.call(queueBeep, freq, duration_ms, gap_ms);
+}
+
+// Add a tone to the buzzer sequencer (UI thread)
+void queueBeep(float freq, int duration_ms, int gap_ms) {
+    ScopedTiming timing(TIME_BEEP);
+    CriticalSectionLock lock;
+    int next = (beepTail + 1) % BEEP_QUEUE_SIZE;
+    if (next == beepHead) {
+        return;  // Queue full, drop the tone
+    }
+    beepQueue[beepTail].freq = freq;
+    beepQueue[beepTail].duration_ms = duration_ms;
+    beepQueue[beepTail].gap_ms = gap_ms;
+    beepTail = next;
+    
+    if (!buzzerBusy) {
+        startNextBeep();
+    }
+}
+
+// Start the next queued tone (called from queueBeep() or the timer ISR)
+void startNextBeep() {
+    if (beepHead == beepTail) {
+        buzzerBusy = false;
+        return;
+    }
+    BeepStep step = beepQueue[beepHead];
+    beepHead = (beepHead + 1) % BEEP_QUEUE_SIZE;
+    buzzerBusy = true;
+    beepGapMs = step.gap_ms;
+    
+    buzzer.period(1.0f / step.freq);
     buzzer.write(0.5f);
-    wait_us(duration_ms * 1000);
+    buzzerTimeout.attach(&endBeep, std::chrono::milliseconds(step.duration_ms));
+}
+
+// Tone finished, silence the buzzer and wait out the gap (timer ISR)
+void endBeep() {
     buzzer.write(0.0f);
+    if (beepGapMs > 0) {
+        buzzerTimeout.attach(&startNextBeep, std::chrono::milliseconds(beepGapMs));
+    } else {
+        startNextBeep();
+    }
 }
 
-// Set RGB based on load level
-void setLoadLevelColor(float load) {
+// Set RGB based on load level (UI thread)
+void setLoadLevelColor(int load) {
+    const float* color = LOAD_COLORS[classifyLoad(load)];
+    setRGB(color[0], color[1], color[2]);
+}
+
+// Load band of an FSR reading (‰)
+LoadClass classifyLoad(int load) {
     if (load < LOAD_LIGHT) {
-        setRGB(0.0f, 1.0f, 0.0f);  // Green for light load
+        return LOAD_CLASS_LIGHT;
     } else if (load < LOAD_MEDIUM) {
-        setRGB(0.5f, 1.0f, 0.0f);  // Yellowish for normal load
+        return LOAD_CLASS_NORMAL;
     } else if (load < LOAD_HEAVY) {
-        setRGB(1.0f, 1.0f, 0.0f);  // Yellow for medium load
+        return LOAD_CLASS_MEDIUM;
     } else if (load < LOAD_OVERLOAD) {
-        setRGB(1.0f, 0.5f, 0.0f);  // Orange for heavy load
-    } else {
-        setRGB(1.0f, 0.0f, 0.0f);  // Red for overload
+        return LOAD_CLASS_HEAVY;
     }
+    return LOAD_CLASS_OVERLOAD;
+}
+
+// Plan for a load class and wash temperature (overload falls back to heavy)
+const CyclePlan& planCycle(LoadClass loadClass, int temp) {
+    int row = loadClass < LOAD_CLASS_OVERLOAD ? loadClass : LOAD_CLASS_HEAVY;
+    return CYCLE_PLANS[row][temp >= PLAN_HOT_TEMP ? 1 : 0];
+}
+
+// Door status LED (UI thread)
+void setDoorLed(bool on) {
+    redLED = on ? 1 : 0;
 }
 
-// Read sensor with averaging to reduce noise
-float readAveragedSensor(AnalogIn& sensor, float scale) {
-    float sum = 0.0f;
-    for (int i = 0; i < NUM_SAMPLES; i++) {
-        sum += sensor.read() * scale;
-        wait_us(5000); // 5ms delay between samples
+// Clear the ADC ring buffer and filters (stale samples from before power off)
+void resetAdcScan() {
+    for (int ch = 0; ch < NUM_ADC_CHANNELS; ch++) {
+        for (int i = 0; i < NUM_SAMPLES; i++) {
+            adcRing[ch][i] = 0;
+        }
+        filterState[ch] = 0;
     }
-    return sum / NUM_SAMPLES;
+    adcHead = 0;
+    adcCount = 0;
 }
 
-// Running the wash cycle
-void runCycleCountdown(int minutes) {
-    int steps = minutes / 10;
-    
-    for (int i = steps; i > 0; --i) {
-        updateDisplay(i);
-        printf("⏳ Cycle countdown: %d0 minutes remaining\n", i);
+// Convert every channel once and run one filter bank step per channel
+void scanAdcChannels() {
+    for (int ch = 0; ch < NUM_ADC_CHANNELS; ch++) {
+        uint16_t sample = adcChannels[ch]->read_u16();
+        adcRing[ch][adcHead] = sample;
+    }
+    adcHead = (adcHead + 1) % NUM_SAMPLES;
+    if (adcCount < NUM_SAMPLES) {
+        adcCount++;
     }
     
-    updateDisplay(0);
-    printf("✅ 🧼 Cycle complete!\n");
+    for (int ch = 0; ch < NUM_ADC_CHANNELS; ch++) {
+        // Spike rejection first, so a glitch never reaches the low-pass
+        int32_t in = (int32_t)medianOfRecent(ch, MEDIAN_TAPS[ch]) << FILTER_FRAC_BITS;
+        
+        // Exponential low-pass: state += alpha × (in - state), first sample primes it
+        if (adcCount == 1) {
+            filterState[ch] = in;
+        } else {
+            filterState[ch] += (int32_t)(((int64_t)(in - filterState[ch]) * FILTER_ALPHA_Q15) >> 15);
+        }
+    }
+}
+
+// Median of the most recent samples of a channel (up to taps, at most 5)
+uint16_t medianOfRecent(int channel, int taps) {
+    int n = taps < adcCount ? taps : adcCount;
+    uint16_t window[NUM_SAMPLES];
     
-    // Completion beep
-    for (int i = 0; i < 3; ++i) {
-        playBeep(1000, 200);
-        wait_us(200000);
+    // Newest first, insertion sorted (n is tiny)
+    for (int i = 0; i < n; i++) {
+        uint16_t v = adcRing[channel][(adcHead - 1 - i + NUM_SAMPLES) % NUM_SAMPLES];
+        int j = i;
+        while (j > 0 && window[j - 1] > v) {
+            window[j] = window[j - 1];
+            j--;
+        }
+        window[j] = v;
     }
+    return window[n / 2];
 }
 
-// Check for significant change in sensor readings
-bool hasSignificantChange(float newVal, float prevVal, float threshold) {
-    return (prevVal < 0 || fabs(newVal - prevVal) >= threshold);
+// Filtered raw reading for a channel (never blocks)
+uint16_t readAdcRaw(AdcChannel channel) {
+    return (uint16_t)((filterState[channel] + (1 << (FILTER_FRAC_BITS - 1))) >> FILTER_FRAC_BITS);
 }
 
-// Check if door is open based on ldr
-bool isDoorOpen() {
-    return (ldrSensor > DOOR_OPEN_THRESHOLD);
+// Scale a raw reading to integer units (Q16 multiply, rounded)
+int scaleRaw(uint16_t raw, uint32_t fullScale) {
+    return (int)((raw * fullScale + 0x8000) >> 16);
+}
+
+// Pot settings, shared by the sensor loop and cycle start
+int potToRpm(uint16_t raw) {
+    return RPM_LUT.value[raw >> (16 - POT_LUT_BITS)];
+}
+
+int potToTemp(uint16_t raw) {
+    return TEMP_LUT.value[raw >> (16 - POT_LUT_BITS)];
+}
+
+int potToTime(uint16_t raw) {
+    return TIME_LUT.value[raw >> (16 - POT_LUT_BITS)];
+}
+
+// Lay out a cycle from the pot settings, by the plan for the load and temperature
+void planManualCycle(int minutes, int rpm, int temp, int load) {
+    LoadClass loadClass = classifyLoad(load);
+    const CyclePlan& plan = planCycle(loadClass, temp);
+    cycleProgram = MANUAL_PROGRAM;
+    cycleRpm = rpm;
+    cycleTemp = temp;
+    cycleMinutes = minutes;
+    cycleLoad = load;
+    cycleTotalMs = planCycleMs(minutes, plan);
+    int end = 0;
+    for (int p = 0; p < NUM_PHASES; p++) {
+        end += cycleTotalMs * plan.phasePercent[p] / 100;
+        phaseEndMs[p] = end;
+        
+        bool spin = PHASE_MOTOR_RPM[p] == SPIN_SETTING;
+        cycleSteps[p].rpm = (uint16_t)(spin ? rpm : PHASE_MOTOR_RPM[p]);
+        cycleSteps[p].rampRpmPerS = spin ? plan.spinRampRpmPerS : 0;
+        cycleSteps[p].tempC = (uint8_t)(PHASE_HEATING[p] ? temp : 0);
+    }
+    phaseEndMs[NUM_PHASES - 1] = cycleTotalMs;
+    logEvent(LOG_CYCLE_PLAN, loadClass, minutes * plan.timePercent / 100, plan.spinRampRpmPerS);
+}
+
+// Lay out a cycle from a wash program, settings are its longest reach
+void planProgramCycle(int number, int load) {
+    const WashProgram& program = programAt(number);
+    cycleProgram = number;
+    cycleRpm = 0;
+    cycleTemp = 0;
+    cycleLoad = load;
+    int end = 0;
+    for (int p = 0; p < NUM_PHASES; p++) {
+        cycleSteps[p] = program.phases[p];
+        end += program.phases[p].durationS * MS_PER_CYCLE_MINUTE / 60;
+        phaseEndMs[p] = end;
+        cycleRpm = program.phases[p].rpm > cycleRpm ? program.phases[p].rpm : cycleRpm;
+        cycleTemp = program.phases[p].tempC > cycleTemp ? program.phases[p].tempC : cycleTemp;
+    }
+    cycleTotalMs = end;
+    cycleMinutes = (cycleTotalMs + MS_PER_CYCLE_MINUTE - 1) / MS_PER_CYCLE_MINUTE;
+}
+
+// Start the laid out cycle. A non-zero resumeMs continues an interrupted
+// cycle that far in.
+void beginCycle(int resumeMs) {
+    // No flash stalls while the drum is under control
+    cycleLogFlushAllowed = false;
+    spinRedistributions = 0;
+    spinRpmLimit = 0;
+    heatHoldMs = 0;
+    heatHolding = false;
+    cycleHeatRate = 0;
+    cycleEco = ecoHeating;
+    cycleHeaterStartJ = heaterEnergyJ;
+    cycleMotorStartJ = motorEnergyJ;
+    
+    cyclePhase = PHASE_FILL;
+    while (resumeMs >= phaseEndMs[cyclePhase] && cyclePhase < PHASE_DRAIN) {
+        cyclePhase = (CyclePhase)(cyclePhase + 1);
+    }
+    phaseStartTime = Kernel::Clock::now();
+    cycleStartTime = phaseStartTime - std::chrono::milliseconds(resumeMs);
+    startHeatMeasurement();
+    lastCountdownStep = -1;
+    logEvent(LOG_PHASE, cyclePhase);
+    applyPhaseSetpoints();
+    
+    // Both checkpoint slots take the new settings on their next write
+    for (int i = 0; i < CHECKPOINT_SLOTS; i++) {
+        checkpointSlotFresh[i] = false;
+    }
+    writeCheckpoint();
+}
+
+// Real cycle length for the pot time under a plan
+int planCycleMs(int minutes, const CyclePlan& plan) {
+    return minutes * MS_PER_CYCLE_MINUTE * plan.timePercent / 100;
+}
+
+// Advance the wash cycle, called once per sensor report while RUNNING. The
+// door is handled before the report (EV_DOOR_OPENED), phase and cycle ends
+// go back to the state machine as completion events.
+MachineEvent updateCycle() {
+    ScopedTiming timing(TIME_CYCLE);
+    
+    int elapsed = cycleElapsedMs();
+    if (elapsed >= cycleTotalMs) {
+        return EV_CYCLE_END;
+    }
+    if (!holdForHeating(elapsed) && elapsed >= phaseEndMs[cyclePhase]) {
+        return EV_PHASE_END;
+    }
+    applyPhaseSetpoints();
+    
+    // Display shows MM-SS in cycle time, as predicted
+    int remainingMs = estimateRemainingMs(elapsed);
+    showTimeRemaining(remainingMs * 60 / MS_PER_CYCLE_MINUTE);
+    
+    // Countdown log in 10 minute steps (rounded up)
+    int remainingMin = (remainingMs + MS_PER_CYCLE_MINUTE - 1) / MS_PER_CYCLE_MINUTE;
+    int step = (remainingMin + 9) / 10;
+    if (step != lastCountdownStep) {
+        lastCountdownStep = step;
+        logEvent(LOG_COUNTDOWN, step);
+    }
+    
+    writeCheckpoint();
+    return EV_NONE;
+}
+
+// Next phase sub-state of RUNNING, then run the tick again in it (a resumed
+// cycle's clock can be past more than one phase end)
+MachineEvent advancePhase() {
+    if (cyclePhase == PHASE_HEAT && !cycleEco) {
+        // Eco heating runs below full power, its rate would lower the prior
+        cycleHeatRate = measuredHeatRate();
+    }
+    
+    // Zero length phases (a program without heating) are passed over
+    do {
+        cyclePhase = (CyclePhase)(cyclePhase + 1);
+    } while (cyclePhase < PHASE_DRAIN && phaseEndMs[cyclePhase] == phaseEndMs[cyclePhase - 1]);
+    phaseStartTime = Kernel::Clock::now();
+    startHeatMeasurement();
+    logEvent(LOG_PHASE, cyclePhase);
+    return EV_SENSOR_REPORT;
+}
+
+// The heat phase measures the drum from its first tick
+void startHeatMeasurement() {
+    if (cyclePhase == PHASE_HEAT) {
+        heatStartTime = Kernel::Clock::now();
+        heatStartTemp = lastReading.tempActual;
+    }
+}
+
+// Heating rate since the heat phase started (m°C/s), 0 until there is enough of it
+int measuredHeatRate() {
+    int ms = (int)(Kernel::Clock::now() - heatStartTime).count();
+    int rise = lastReading.tempActual - heatStartTemp;
+    if (ms < HEAT_RATE_MIN_MS || rise <= 0) {
+        return 0;
+    }
+    return (int)((int64_t)rise * 100 * 1000 / ms);
+}
+
+// Heating rate to predict with: the load class prior, weighed against the
+// measurement as heating goes on
+int heatRateEstimate() {
+    int prior = heatRatePrior[classifyLoad(cycleLoad)];
+    int measured = cyclePhase == PHASE_HEAT ? measuredHeatRate() : 0;
+    if (measured == 0) {
+        return prior;
+    }
+    int64_t ms = (Kernel::Clock::now() - heatStartTime).count();
+    return (int)(((int64_t)prior * HEAT_RATE_PRIOR_MS + measured * ms) / (HEAT_RATE_PRIOR_MS + ms));
+}
+
+// Predicted remaining cycle time: the plan's remaining time, plus the hold
+// the drum will still need to warm beyond the planned heating (O(1), every tick)
+int estimateRemainingMs(int elapsed) {
+    int remaining = cycleTotalMs - elapsed;
+    int needed = cycleSteps[PHASE_HEAT].tempC * 10 - HEAT_REACHED_TOLERANCE - lastReading.tempActual;
+    if (cycleEco || cyclePhase > PHASE_HEAT || cycleSteps[PHASE_HEAT].tempC == 0 || needed <= 0) {
+        return remaining;
+    }
+    
+    int heatStart = phaseEndMs[PHASE_FILL];
+    int plannedLeft = phaseEndMs[PHASE_HEAT] - (elapsed > heatStart ? elapsed : heatStart);
+    int holdLeft = (phaseEndMs[PHASE_HEAT] - heatStart) * HEAT_HOLD_MAX_PERCENT / 100 - heatHoldMs;
+    int extra = (int)((int64_t)needed * 100 * 1000 / heatRateEstimate()) - plannedLeft;
+    extra = extra > holdLeft ? holdLeft : extra;
+    return remaining + (extra > 0 ? extra : 0);
+}
+
+// Keep the heat phase running past its planned end until the drum is warm
+// (up to HEAT_HOLD_MAX_PERCENT more), holding the cycle clock just short of
+// the end. Returns true while holding. A checkpoint taken now resumes into
+// the hold. Eco heating never holds, it heats on into the wash.
+bool holdForHeating(int& elapsed) {
+    int pinned = phaseEndMs[PHASE_HEAT] - 1;
+    if (cycleEco || cyclePhase != PHASE_HEAT || elapsed < pinned) {
+        return false;
+    }
+    
+    int temp = lastReading.tempActual;
+    bool warm = temp >= cycleSteps[PHASE_HEAT].tempC * 10 - HEAT_REACHED_TOLERANCE;
+    int maxHold = (phaseEndMs[PHASE_HEAT] - phaseEndMs[PHASE_FILL]) * HEAT_HOLD_MAX_PERCENT / 100;
+    if (!warm && heatHoldMs < maxHold) {
+        if (!heatHolding) {
+            heatHolding = true;
+            logEvent(LOG_HEAT_HOLD, (temp + 5) / 10, cycleSteps[PHASE_HEAT].tempC);
+        }
+        heatHoldMs += elapsed - pinned;
+        cycleStartTime += std::chrono::milliseconds(elapsed - pinned);
+        elapsed = pinned;
+        return true;
+    }
+    if (heatHolding) {
+        heatHolding = false;
+        logEvent(warm ? LOG_HEAT_DONE : LOG_HEAT_TIMEOUT, (temp + 5) / 10);
+    }
+    return false;
+}
+
+// Eco heater cap (‰): the duty that warms the drum by ECO_HEAT_TARGET_PERCENT
+// into the wash at the full power rate of past cycles, with a margin. Full
+// power once the target is passed or the drum is warm.
+int32_t ecoHeaterLimit(int elapsed) {
+    int needed = cycleSteps[PHASE_WASH].tempC * 10 - HEAT_REACHED_TOLERANCE - lastReading.tempActual;
+    int target = phaseEndMs[PHASE_HEAT] + (phaseEndMs[PHASE_WASH] - phaseEndMs[PHASE_HEAT]) * ECO_HEAT_TARGET_PERCENT / 100;
+    int left = target - elapsed;
+    if (cyclePhase > PHASE_WASH || needed <= 0 || left <= 0) {
+        return PID_OUTPUT_MAX;
+    }
+    
+    // Time the rise takes at full power, as a share of the time left
+    int64_t fullPowerMs = (int64_t)needed * 100 * 1000 / heatRatePrior[classifyLoad(cycleLoad)];
+    int64_t limit = fullPowerMs * ECO_HEAT_MARGIN_PERCENT / 100 * PID_OUTPUT_MAX / left;
+    return (int32_t)(limit > PID_OUTPUT_MAX ? PID_OUTPUT_MAX : (limit < ECO_MIN_DUTY ? ECO_MIN_DUTY : limit));
+}
+
+// Imbalance during spin: tumble to spread the load and spin up again, and
+// once that has failed MAX_REDISTRIBUTIONS times, spin slower instead
+MachineEvent rebalanceSpin() {
+    // Report from a spin that has ended since, or after the speed was cut
+    if (cycleSteps[cyclePhase].rampRpmPerS == 0 || spinRpmLimit != 0) {
+        return EV_NONE;
+    }
+    
+    if (spinRedistributions < MAX_REDISTRIBUTIONS) {
+        spinRedistributions++;
+        phaseStartTime = Kernel::Clock::now() + std::chrono::milliseconds(REDISTRIBUTE_MS);
+        logEvent(LOG_IMBALANCE, imbalanceRpm, spinRedistributions, MAX_REDISTRIBUTIONS);
+    } else {
+        spinRpmLimit = cycleSteps[cyclePhase].rpm * SPIN_REDUCED_PERCENT / 100;
+        logEvent(LOG_SPIN_REDUCED, spinRpmLimit);
+    }
+    applyPhaseSetpoints();
+    return EV_NONE;
+}
+
+// Cycle time run so far, frozen while PAUSED
+int cycleElapsedMs() {
+    if (inState(PAUSED)) {
+        return pausedElapsedMs;
+    }
+    return (int)(Kernel::Clock::now() - cycleStartTime).count();
+}
+
+// Freeze the cycle clock and park the heater and drum
+MachineEvent pauseCycle() {
+    pausedElapsedMs = cycleElapsedMs();
+    pauseTime = Kernel::Clock::now();
+    setPidSetpoints(0, 0);
+    writeCheckpoint();
+    logEvent(LOG_CYCLE_PAUSED, (cycleTotalMs - pausedElapsedMs + MS_PER_CYCLE_MINUTE - 1) / MS_PER_CYCLE_MINUTE);
+    playBeep(500, 100);
+    return EV_NONE;
+}
+
+// Continue a paused cycle from where its clock stopped
+MachineEvent unpauseCycle() {
+    Kernel::Clock::time_point now = Kernel::Clock::now();
+    cycleStartTime = now - std::chrono::milliseconds(pausedElapsedMs);
+    phaseStartTime += now - pauseTime;   // The spin ramp picks up where it was
+    heatStartTime += now - pauseTime;    // Heater was off, not part of the rate
+    logEvent(LOG_CYCLE_UNPAUSED, (cycleTotalMs - pausedElapsedMs + MS_PER_CYCLE_MINUTE - 1) / MS_PER_CYCLE_MINUTE);
+    playBeep(700, 100);
+    return EV_NONE;
+}
+
+MachineEvent refuseResumeDoorOpen() {
+    logEvent(LOG_RESUME_DOOR_OPEN);
+    playBeep(300, 500);
+    return EV_NONE;
+}
+
+// Cycle ran to completion
+MachineEvent finishCycle() {
+    setPidSetpoints(0, 0);
+    recordCycle(OUTCOME_COMPLETE);
+    clearCheckpoint();
+    showTimeRemaining(0);
+    logEvent(LOG_CYCLE_COMPLETE);
+    
+    // Completion beep
+    for (int i = 0; i < 3; ++i) {
+        playBeep(1000, 200, 200);
+    }
+    
+    logEvent(LOG_CYCLE_ENDED);
+    return checkStartInhibit();
+}
+
+// Stop the cycle early, reason is the event explaining why
+void abortCycle(LogEvent reason, CycleOutcome outcome) {
+    setPidSetpoints(0, 0);
+    recordCycle(outcome);
+    clearCheckpoint();
+    logEvent(reason);
+    playBeep(300, 500);
+    logEvent(LOG_CYCLE_ENDED);
+}
+
+// Start/pause held while a cycle runs or is paused
+MachineEvent cancelCycle() {
+    abortCycle(LOG_CYCLE_CANCELLED, OUTCOME_CANCELLED);
+    return checkStartInhibit();
+}
+
+// Safety first, an open door stops the cycle on the report that saw it
+MachineEvent abortDoorOpen() {
+    abortCycle(LOG_ABORT_DOOR, OUTCOME_DOOR_ABORT);
+    return EV_NONE;
+}
+
+// The fault manager has already turned the outputs off
+MachineEvent abortFault() {
+    abortCycle(LOG_ABORT_FAULT, OUTCOME_FAULT);
+    return checkStartInhibit();
+}
+
+// Enable backup domain writes and look for a cycle cut short by a power loss
+void initCheckpoint() {
+    __HAL_RCC_PWR_CLK_ENABLE();
+    HAL_PWR_EnableBkUpAccess();
+    
+    CycleCheckpoint slots[CHECKPOINT_SLOTS];
+    bool valid[CHECKPOINT_SLOTS];
+    for (int i = 0; i < CHECKPOINT_SLOTS; i++) {
+        valid[i] = readCheckpointSlot(i, slots[i]);
+    }
+    
+    // Newest valid slot, a torn write leaves the other one
+    int newest = -1;
+    for (int i = 0; i < CHECKPOINT_SLOTS; i++) {
+        if (valid[i] && (newest < 0 || (int16_t)(slots[i].seq - slots[newest].seq) > 0)) {
+            newest = i;
+        }
+    }
+    if (newest >= 0) {
+        resumeCheckpoint = slots[newest];
+        resumeAvailable = true;
+        checkpointSeq = resumeCheckpoint.seq + 1;
+    }
+}
+
+// Save the running cycle into the older slot: sequence, elapsed time and the
+// check word, plus the settings the first time a slot is used for this cycle.
+// A handful of register writes, cheap enough for every tick.
+void writeCheckpoint() {
+    int slot = checkpointSeq % CHECKPOINT_SLOTS;
+    volatile uint32_t* regs = &RTC->BKP0R + slot * CHECKPOINT_WORDS;
+    
+    uint32_t w0 = (CHECKPOINT_MAGIC << 16) | checkpointSeq;
+    uint32_t w1 = (uint32_t)cycleElapsedMs();
+    uint32_t w2 = ((uint32_t)cycleRpm << 16) | ((uint32_t)cycleMinutes << 8) | (uint32_t)cycleTemp;
+    uint32_t w3 = ((uint32_t)cycleLoad << 16) | ((uint32_t)cyclePhase << 8) | (uint32_t)cycleProgram;
+    
+    // Invalidate first, so a reset part way through never validates a mix
+    regs[4] = 0;
+    regs[0] = w0;
+    regs[1] = w1;
+    if (!checkpointSlotFresh[slot]) {
+        regs[2] = w2;
+        checkpointSlotFresh[slot] = true;
+    }
+    regs[3] = w3;
+    regs[4] = w0 ^ w1 ^ w2 ^ w3 ^ CHECKPOINT_KEY;
+    checkpointSeq++;
+}
+
+bool readCheckpointSlot(int slot, CycleCheckpoint& out) {
+    volatile uint32_t* regs = &RTC->BKP0R + slot * CHECKPOINT_WORDS;
+    uint32_t w[CHECKPOINT_WORDS];
+    for (int i = 0; i < CHECKPOINT_WORDS; i++) {
+        w[i] = regs[i];
+    }
+    if ((w[0] >> 16) != CHECKPOINT_MAGIC || (w[0] ^ w[1] ^ w[2] ^ w[3] ^ CHECKPOINT_KEY) != w[4]) {
+        return false;
+    }
+    
+    out.seq = (uint16_t)w[0];
+    out.elapsedMs = w[1];
+    out.rpm = (uint16_t)(w[2] >> 16);
+    out.minutes = (uint8_t)(w[2] >> 8);
+    out.temp = (uint8_t)w[2];
+    out.load = (uint16_t)(w[3] >> 16);
+    out.phase = (uint8_t)(w[3] >> 8);
+    out.program = (uint8_t)w[3];
+    return true;
+}
+
+// Cycle ended normally or was abandoned, nothing to resume
+void clearCheckpoint() {
+    for (int i = 0; i < CHECKPOINT_SLOTS * CHECKPOINT_WORDS; i++) {
+        (&RTC->BKP0R)[i] = 0;
+    }
+    resumeAvailable = false;
+}
+
+// Start the IWDG and the supervisor that feeds it. Nothing stops the IWDG
+// once started, so the supervisor keeps kicking it in standby.
+void startWatchdog() {
+    Watchdog::get_instance().start(WATCHDOG_TIMEOUT_MS);
+    supervisorTicker.attach(&superviseTasks, std::chrono::milliseconds(SUPERVISOR_PERIOD_MS));
+}
+
+// Supervisor tick (ISR): the watchdog is kicked only while every supervised
+// task keeps checking in. A task quiet for its deadline turns the outputs
+// off and starves the watchdog, which resets the machine.
+void superviseTasks() {
+    bool held = supervisionHeld.load(std::memory_order_relaxed);
+    for (int t = 0; t < NUM_SUPERVISED_TASKS; t++) {
+        uint32_t count = taskCheckIns[t].load(std::memory_order_relaxed);
+        if (held || !taskSupervised[t].load(std::memory_order_relaxed) || count != taskSeenCheckIns[t]) {
+            taskSeenCheckIns[t] = count;
+            taskQuietMs[t] = 0;
+            continue;
+        }
+        taskQuietMs[t] += SUPERVISOR_PERIOD_MS;
+        if (taskQuietMs[t] >= TASK_DEADLINE_MS[t] && !watchdogStarved) {
+            enterSafeState(FAULT_MISSED_DEADLINE, t);
+            watchdogStarved = true;
+        }
+    }
+    if (!watchdogStarved) {
+        Watchdog::get_instance().kick();
+    }
+}
+
+// A supervised task is alive (any thread or ISR)
+void checkIn(SupervisedTask task) {
+    taskCheckIns[task].fetch_add(1, std::memory_order_relaxed);
+}
+
+// Deadlines only apply while a task is meant to run
+void superviseTask(SupervisedTask task, bool supervised) {
+    taskSupervised[task].store(supervised, std::memory_order_relaxed);
+}
+
+// Turn the heater and motor off at once and record the cause in the backup
+// domain (safety thread or supervisor ISR). Returns false if a fault was
+// already latched; the first one holds until the control thread clears it.
+bool enterSafeState(FaultCause cause, int detail) {
+    uint8_t none = FAULT_NONE;
+    bool latched = activeFault.compare_exchange_strong(none, (uint8_t)cause);
+    heater.write(0.0f);
+    motor.write(0.0f);
+    if (latched) {
+        (&RTC->BKP0R)[FAULT_REGISTER] = FAULT_RECORD_MAGIC << 16 | (uint32_t)(detail & 0xFF) << 8 | cause;
+    }
+    return latched;
+}
+
+// Door open or drum too hot while the heater or motor is driven: outputs off
+// and logged in this tick, the control thread ends the cycle (safety thread)
+void checkOutputFaults(int tempActual) {
+    bool driven = heaterSetpoint.load(std::memory_order_relaxed) > 0 ||
+                  motorSetpoint.load(std::memory_order_relaxed) > 0;
+    if (!driven || activeFault.load() != FAULT_NONE) {
+        return;
+    }
+    FaultCause cause = doorOpenWarningActive ? FAULT_DOOR_OPEN :
+                       tempActual > TEMP_FAULT_LIMIT ? FAULT_OVERTEMP : FAULT_NONE;
+    if (cause != FAULT_NONE && enterSafeState(cause, tempActual / 10)) {
+        logEvent(LOG_FAULT, cause);
+        controlQueue.call(onFault, (int)cause);
+    }
+}
+
+// Fault latched by the safety thread: end the cycle, then release the
+// outputs for the next one (control thread). A door fault's report was
+// queued first, so EV_DOOR_OPENED has already ended the cycle as a door
+// abort and EV_FAULT finds no cycle; it only ends one for overtemperature.
+void onFault(int cause) {
+    dispatchEvent(EV_FAULT);
+    uint8_t latched = (uint8_t)cause;
+    if (activeFault.compare_exchange_strong(latched, FAULT_NONE)) {
+        (&RTC->BKP0R)[FAULT_REGISTER] = 0;
+    }
+}
+
+// Report a fault recorded before the last reset, which the control thread
+// never got to, then clear it. The cycle it cut short goes into the log as
+// a fault instead of being offered for resume. (boot, after initCheckpoint())
+void reportFaultRecord() {
+    uint32_t record = (&RTC->BKP0R)[FAULT_REGISTER];
+    (&RTC->BKP0R)[FAULT_REGISTER] = 0;
+    int cause = (int)(record & 0xFF);
+    int detail = (int)((record >> 8) & 0xFF);
+    if (record >> 16 != FAULT_RECORD_MAGIC || cause >= NUM_FAULT_CAUSES) {
+        if (ResetReason::get() == RESET_REASON_WATCHDOG) {
+            logEvent(LOG_WATCHDOG_UNEXPLAINED);
+        }
+        return;
+    }
+    if (cause == FAULT_MISSED_DEADLINE) {
+        logEvent(LOG_WATCHDOG_RESET, detail);
+    } else {
+        logEvent(LOG_FAULT_BEFORE_RESET, cause);
+    }
+    
+    if (resumeAvailable) {
+        recordCheckpointCycle(resumeCheckpoint, OUTCOME_FAULT);
+        clearCheckpoint();
+        logEvent(LOG_ABORT_FAULT);
+    }
+}
+
+// Switch the serial output between text lines and binary frames. The
+// mode is kept in the backup domain, so a collector reading frames keeps
+// receiving them after a reset (control thread).
+void setTelemetryMode(bool binary) {
+    telemetryBinary = binary;
+    (&RTC->BKP0R)[MODE_REGISTER] = MODE_RECORD_MAGIC << 16 | (binary ? 1 : 0);
+}
+
+// Restore the telemetry mode set before the last reset (boot, after
+// initCheckpoint() enabled backup domain access)
+void initTelemetryMode() {
+    uint32_t record = (&RTC->BKP0R)[MODE_REGISTER];
+    if (record >> 16 == MODE_RECORD_MAGIC) {
+        telemetryBinary = (record & 1) != 0;
+    }
+}
+
+// Cycle time a checkpointed cycle still had to run. A program missing from
+// the table since falls back to the pot plan for its settings.
+int checkpointRemainingMs(const CycleCheckpoint& cp) {
+    if (cp.program != MANUAL_PROGRAM && cp.program <= programCount()) {
+        return programCycleMs(programAt(cp.program)) - (int)cp.elapsedMs;
+    }
+    return planCycleMs(cp.minutes, planCycle(classifyLoad(cp.load), cp.temp)) - (int)cp.elapsedMs;
+}
+
+// Continue the interrupted cycle from its checkpoint
+MachineEvent resumeCycle() {
+    const CycleCheckpoint& cp = resumeCheckpoint;
+    logEvent(LOG_CYCLE_RESUMED, cp.rpm, cp.temp, checkpointRemainingMs(cp) / MS_PER_CYCLE_MINUTE);
+    playBeep(700, 100);
+    
+    resumeAvailable = false;
+    if (cp.program != MANUAL_PROGRAM && cp.program <= programCount()) {
+        planProgramCycle(cp.program, cp.load);
+    } else {
+        planManualCycle(cp.minutes, cp.rpm, cp.temp, cp.load);
+    }
+    beginCycle((int)cp.elapsedMs);
+    return EV_CYCLE_STARTED;
+}
+
+// Heater and motor setpoints for the current phase
+void applyPhaseSetpoints() {
+    const ProgramPhase& step = cycleSteps[cyclePhase];
+    int rpm = step.rpm;
+    if (step.rampRpmPerS != 0) {
+        // Spin up from tumble speed at the phase's rate, a redistribution
+        // pass tumbles until the ramp start
+        int top = spinRpmLimit != 0 && spinRpmLimit < step.rpm ? spinRpmLimit : step.rpm;
+        int rampMs = (int)(Kernel::Clock::now() - phaseStartTime).count();
+        rpm = rampMs < 0 ? TUMBLE_RPM : TUMBLE_RPM + step.rampRpmPerS * rampMs / 1000;
+        rpm = rpm > top ? top : rpm;
+    }
+    setPidSetpoints(step.tempC, rpm);
+    heaterDutyLimit.store(cycleEco ? ecoHeaterLimit(cycleElapsedMs()) : PID_OUTPUT_MAX, std::memory_order_relaxed);
+}
+
+// Hand new setpoints to the PID ISR (temp in °C, 0 turns an output off)
+void setPidSetpoints(int temp, int rpm) {
+    heaterSetpoint.store(temp * 10, std::memory_order_relaxed);
+    motorSetpoint.store(rpm, std::memory_order_relaxed);
+}
+
+// Start the PID timer from a stopped drum and cold loops
+void startPid() {
+    heater.period_ms(HEATER_PWM_PERIOD_MS);
+    motor.period_us(MOTOR_PWM_PERIOD_US);
+    motorRpmQ8 = 0;
+    pidReset(heaterPid, heaterMeasured);
+    pidReset(motorPid, 0);
+    heaterDivider = 0;
+    pidTicker.attach(&pidTick, std::chrono::microseconds(PID_TICK_US));
+    superviseTask(TASK_PID, true);
+}
+
+// Stop the PID timer with both outputs off
+void stopPid() {
+    superviseTask(TASK_PID, false);
+    pidTicker.detach();
+    setPidSetpoints(0, 0);
+    heater.write(0.0f);
+    motor.write(0.0f);
+}
+
+// Fixed-rate control tick (timer ISR): motor every tick, heater every
+// HEATER_TICK_DIVIDER ticks.
+// There is no tachometer, so the motor loop closes on a first-order model
+// of the drum (duty × MOTOR_MAX_RPM, time constant MOTOR_TAU_MS).
+void pidTick() {
+    ScopedTiming timing(TIME_PID);
+    
+    checkIn(TASK_PID);
+    bool faulted = activeFault.load(std::memory_order_relaxed) != FAULT_NONE;
+    
+    int32_t rpm = motorRpmQ8 >> PID_FRAC_BITS;
+    int32_t motorSet = faulted ? 0 : motorSetpoint.load(std::memory_order_relaxed);
+    int32_t motorOut = 0;
+    if (motorSet > 0) {
+        motorOut = pidUpdate(motorPid, motorSet, rpm);
+    } else {
+        pidReset(motorPid, rpm);
+    }
+    motor.write(motorOut / (float)PID_OUTPUT_MAX);
+    meterEnergy(motorEnergyJ, motorEnergyUj, motorOut, MOTOR_POWER_W, PID_TICK_US);
+    
+    int32_t targetQ8 = (motorOut * MOTOR_MAX_RPM / PID_OUTPUT_MAX) << PID_FRAC_BITS;
+    motorRpmQ8 += (targetQ8 - motorRpmQ8) * PID_TICK_US / (MOTOR_TAU_MS * 1000);
+    
+    if (++heaterDivider < HEATER_TICK_DIVIDER) {
+        return;
+    }
+    heaterDivider = 0;
+    
+    // Filtered drum temperature, the previous value if the snapshot is mid-write
+    SensorSnapshot snapshot;
+    if (tryReadSnapshot(snapshot)) {
+        heaterMeasured = snapshot.tempActual;
+    }
+    int32_t heaterSet = faulted ? 0 : heaterSetpoint.load(std::memory_order_relaxed);
+    int32_t heaterOut = 0;
+    if (heaterSet > 0) {
+        heaterOut = pidUpdate(heaterPid, heaterSet, heaterMeasured, heaterDutyLimit.load(std::memory_order_relaxed));
+    } else {
+        pidReset(heaterPid, heaterMeasured);
+    }
+    heater.write(heaterOut / (float)PID_OUTPUT_MAX);
+    meterEnergy(heaterEnergyJ, heaterEnergyUj, heaterOut, HEATER_POWER_W, PID_TICK_US * HEATER_TICK_DIVIDER);
+}
+
+// Add one output period at a duty (‰) to a meter (PID ISR)
+void meterEnergy(std::atomic<uint32_t>& joules, uint32_t& microjoules, int32_t duty, int powerW, int periodUs) {
+    // ‰ × W × µs / 1000 = µJ
+    microjoules += (uint32_t)((int64_t)duty * powerW * periodUs / PID_OUTPUT_MAX);
+    if (microjoules >= 1000000) {
+        joules.fetch_add(microjoules / 1000000, std::memory_order_relaxed);
+        microjoules %= 1000000;
+    }
+}
+
+// One PID step, returns the output in ‰ duty (0 to outputMax).
+// Anti-windup: the integral is clamped to the output range and stops
+// growing while the output is saturated in the direction of the error.
+int32_t pidUpdate(PidController& pid, int32_t setpoint, int32_t measured, int32_t outputMax) {
+    int32_t error = setpoint - measured;
+    int32_t derivative = measured - pid.prevMeasured;
+    pid.prevMeasured = measured;
+    
+    int32_t integral = pid.integral + pid.ki * error;
+    int32_t limit = outputMax << PID_FRAC_BITS;
+    integral = integral > limit ? limit : (integral < 0 ? 0 : integral);
+    
+    int32_t out = (pid.kp * error + integral - pid.kd * derivative) >> PID_FRAC_BITS;
+    if (out > outputMax) {
+        out = outputMax;
+        if (error < 0) {
+            pid.integral = integral;
+        }
+    } else if (out < 0) {
+        out = 0;
+        if (error > 0) {
+            pid.integral = integral;
+        }
+    } else {
+        pid.integral = integral;
+    }
+    return out;
+}
+
+// Clear a loop, the next step starts without integral or derivative kick
+void pidReset(PidController& pid, int32_t measured) {
+    pid.integral = 0;
+    pid.prevMeasured = measured;
+}
+
+// Check for significant change in sensor readings
+bool hasSignificantChange(int newVal, int prevVal, int threshold) {
+    return (prevVal < 0 || abs(newVal - prevVal) >= threshold);
+}
+
+// Check if door is open based on ldr (light level in 0.1%)
+bool isDoorOpen(int ldr) {
+    return (ldr > doorOpenThreshold);
+}
+
+// Debounced door state: changes only after DEBOUNCE_COUNT consistent readings
+bool debounceDoor(bool reading) {
+    if (reading) {
+        doorOpenCount++;
+        doorClosedCount = 0;
+    } else {
+        doorClosedCount++;
+        doorOpenCount = 0;
+    }
+    
+    return doorOpenWarningActive ? 
+           (doorClosedCount < DEBOUNCE_COUNT) : 
+           (doorOpenCount >= DEBOUNCE_COUNT);
 }
 
 // Check if washer is overloaded
-bool isOverloaded(float load) {
+bool isOverloaded(int load) {
     return (load > LOAD_OVERLOAD);
 }
 
-// Update 7 segment display
-void updateDisplay(int value) {
+// Queue a telemetry frame (any thread, never blocks).
+// A full ring drops the frame, the receiver sees a sequence gap.
+void pushTelemetry(TelemetryFrame& frame) {
+    frame.time_ms = (uint32_t)Kernel::Clock::now().time_since_epoch().count();
+    {
+        // Producers on several threads, the slot claim and copy are one step
+        CriticalSectionLock lock;
+        uint32_t tail = telemetryTail.load(std::memory_order_relaxed);
+        if (tail - telemetryHead.load(std::memory_order_acquire) >= TELEMETRY_QUEUE_SIZE) {
+            telemetrySeq++;
+            return;
+        }
+        
+        frame.seq = telemetrySeq++;
+        telemetryRing[tail % TELEMETRY_QUEUE_SIZE] = frame;
+        telemetryTail.store(tail + 1, std::memory_order_release);
+    }
+    
+    // One drain event per burst
+    if (!telemetryDrainPending.exchange(true)) {
+        telemetryQueue.call(drainTelemetry);
+    }
+}
+
+// Log an event with up to three arguments
+void logEvent(LogEvent code, int a, int b, int c) {
+    TelemetryFrame frame = {TLM_EVENT, (uint8_t)code, 0, 0, {(int16_t)a, (int16_t)b, (int16_t)c, 0}};
+    pushTelemetry(frame);
+}
+
+// Log the pot settings
+void logSettings(int rpm, int temp, int time) {
+    TelemetryFrame frame = {TLM_SETTINGS, 0, 0, 0, {(int16_t)rpm, (int16_t)temp, (int16_t)time, 0}};
+    pushTelemetry(frame);
+}
+
+// Log the state, and the phase and predicted time left of a cycle
+void logStatus() {
+    bool cycle = inState(RUNNING) || inState(PAUSED);
+    int remaining = cycle ? estimateRemainingMs(cycleElapsedMs()) : 0;
+    TelemetryFrame frame = {TLM_STATUS, (uint8_t)systemState, 0, 0,
+                            {(int16_t)cyclePhase, (int16_t)((remaining + MS_PER_CYCLE_MINUTE - 1) / MS_PER_CYCLE_MINUTE),
+                             (int16_t)(cycle ? cycleProgram : selectedProgram), 0}};
+    pushTelemetry(frame);
+}
+
+// Answer to a command, after any frames it asked for
+void logReply(CommandCode code, CommandStatus status, int count) {
+    TelemetryFrame frame = {TLM_REPLY, (uint8_t)code, 0, 0, {(int16_t)status, (int16_t)count, 0, 0}};
+    pushTelemetry(frame);
+}
+
+// Log the sensor readings (fixed-point units)
+void logSensors(int load, int temp, int light, bool doorOpen) {
+    TelemetryFrame frame = {TLM_SENSORS, 0, 0, 0, {(int16_t)load, (int16_t)temp, (int16_t)light, (int16_t)doorOpen}};
+    pushTelemetry(frame);
+}
+
+// Send every queued frame (telemetry thread)
+void drainTelemetry() {
+    // Clear first, a frame queued from here on posts a new drain
+    telemetryDrainPending = false;
+    
+    uint32_t head = telemetryHead.load(std::memory_order_relaxed);
+    while (head != telemetryTail.load(std::memory_order_acquire)) {
+        const TelemetryFrame& frame = telemetryRing[head % TELEMETRY_QUEUE_SIZE];
+        if (telemetryBinary) {
+            sendTelemetryFrame(frame);
+        } else {
+            printTelemetryFrame(frame);
+        }
+        head++;
+        telemetryHead.store(head, std::memory_order_release);
+    }
+}
+
+// Human readable form of a frame (the original log lines)
+void printTelemetryFrame(const TelemetryFrame& frame) {
+    const int16_t* v = frame.values;
+    switch (frame.type) {
+        case TLM_SETTINGS:
+            printf("⚙️ RPM: %d | 🌡️ Temp Set: %d°C | ⏱️ Time: %d min\n", v[0], v[1], v[2]);
+            break;
+            
+        case TLM_SENSORS:
+            printf("📦 Load: %d.%02d | 🌡️ Temp: %d°C | 🚪 %s\n", v[0] / 1000, (v[0] % 1000) / 10,
+                   (v[1] + 5) / 10, v[3] ? "Door Open" : "Door Closed");
+            break;
+            
+        case TLM_STATUS:
+            if (frame.code == RUNNING || frame.code == PAUSED || frame.code == PAUSED_DOOR_OPEN) {
+                printf("📊 %s: %s, %d minutes left, program %d\n", STATE_NAMES[frame.code],
+                       PHASE_NAMES[v[0] % NUM_PHASES], v[1], v[2]);
+            } else if (frame.code < NUM_SYSTEM_STATES) {
+                printf("📊 %s, program %d selected\n", STATE_NAMES[frame.code], v[2]);
+            }
+            break;
+            
+        case TLM_REPLY:
+            printf("↩️ Command 0x%02x: %s\n", frame.code, COMMAND_STATUS_NAMES[v[0] % NUM_COMMAND_STATUSES]);
+            break;
+            
+        case TLM_EVENT:
+            if (frame.code == LOG_PHASE) {
+                printf(LOG_TEXT[LOG_PHASE], PHASE_NAMES[v[0]]);
+            } else if (frame.code == LOG_PROGRAM_SELECTED) {
+                int number = v[0] >= 1 && v[0] <= programCount() ? v[0] : 1;
+                printf(LOG_TEXT[LOG_PROGRAM_SELECTED], v[0], programAt(number).name, v[1]);
+            } else if (frame.code == LOG_FAULT || frame.code == LOG_FAULT_BEFORE_RESET) {
+                printf(LOG_TEXT[frame.code], FAULT_NAMES[v[0] % NUM_FAULT_CAUSES]);
+            } else if (frame.code == LOG_WATCHDOG_RESET) {
+                printf(LOG_TEXT[LOG_WATCHDOG_RESET], TASK_NAMES[v[0] % NUM_SUPERVISED_TASKS]);
+            } else if (frame.code == LOG_CYCLE_PLAN) {
+                printf(LOG_TEXT[LOG_CYCLE_PLAN], LOAD_CLASS_NAMES[v[0]], v[1], v[2]);
+            } else if (frame.code < NUM_LOG_EVENTS) {
+                printf(LOG_TEXT[frame.code], v[0], v[1], v[2]);
+            }
+            break;
+    }
+}
+
+// Binary form of a frame
+void sendTelemetryFrame(const TelemetryFrame& frame) {
+    sendFrame(&frame, sizeof(frame));
+}
+
+// SYNC, length, payload, checksum (sum of all preceding bytes + checksum
+// == 0 mod 256). Telemetry thread, the only serial writer.
+void sendFrame(const void* payload, int length) {
+    uint8_t buf[TELEMETRY_MAX_PAYLOAD + 3];
+    buf[0] = TELEMETRY_SYNC;
+    buf[1] = (uint8_t)length;
+    memcpy(&buf[2], payload, length);
+    
+    uint8_t sum = 0;
+    for (int i = 0; i < length + 2; i++) {
+        sum += buf[i];
+    }
+    buf[length + 2] = (uint8_t)(0x100 - sum);
+    serialPort.write(buf, length + 3);
+}
+
+// Find the log region and the next free slot. The log takes the last
+// CYCLE_LOG_SECTORS sectors of flash. The active sector is the one whose
+// first record has the highest sequence number, its used slots are a
+// prefix, so a binary search finds the head: O(sectors + log slots).
+void initCycleLog() {
+    if (flash.init() != 0 || sizeof(CycleRecord) % flash.get_page_size() != 0) {
+        return;
+    }
+    
+    uint32_t end = flash.get_flash_start() + flash.get_flash_size();
+    uint32_t start = end;
+    for (int i = 0; i < CYCLE_LOG_SECTORS; i++) {
+        start -= flash.get_sector_size(start - 1);
+    }
+    
+    // No log if the application image grew into its sectors, the first
+    // flush would erase code
+    if (start < FLASHIAP_APP_ROM_END_ADDR) {
+        return;
+    }
+    
+    uint32_t active = 0;
+    uint32_t newest = 0;
+    for (uint32_t sector = start; sector < end; sector += flash.get_sector_size(sector)) {
+        uint32_t seq = readRecordSeq(sector);
+        if (seq != CYCLE_LOG_FREE && (active == 0 || seq > newest)) {
+            active = sector;
+            newest = seq;
+        }
+    }
+    
+    cycleLogStart = start;
+    cycleLogEnd = end;
+    if (active == 0) {
+        cycleLogHead = start;   // Empty log
+        cycleLogSeq = 0;
+        return;
+    }
+    
+    // First free slot of the active sector
+    uint32_t lo = 1;
+    uint32_t hi = flash.get_sector_size(active) / sizeof(CycleRecord);
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (readRecordSeq(active + mid * sizeof(CycleRecord)) == CYCLE_LOG_FREE) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    uint32_t last = active + (lo - 1) * sizeof(CycleRecord);
+    cycleLogSeq = readRecordSeq(last) + 1;
+    cycleLogHead = last + sizeof(CycleRecord);
+    if (cycleLogHead >= end) {
+        cycleLogHead = start;
+    }
+}
+
+uint32_t readRecordSeq(uint32_t addr) {
+    uint32_t seq = CYCLE_LOG_FREE;
+    flash.read(&seq, addr, sizeof(seq));
+    return seq;
+}
+
+// Queue the record for the cycle that just ended (control thread)
+void recordCycle(CycleOutcome outcome) {
+    CycleRecord record;
+    memset(&record, 0, sizeof(record));
+    record.uptime_s = (uint32_t)(Kernel::Clock::now().time_since_epoch().count() / 1000);
+    // The heat hold moves the cycle clock back, so add it in again
+    record.duration_s = (uint32_t)((cycleElapsedMs() + heatHoldMs) / 1000);
+    record.minutes = (uint16_t)(cycleTotalMs / MS_PER_CYCLE_MINUTE);
+    record.rpm = (uint16_t)cycleRpm;
+    record.load = (uint16_t)cycleLoad;
+    record.temp = (uint8_t)cycleTemp;
+    record.loadClass = (uint8_t)classifyLoad(cycleLoad);
+    record.outcome = (uint8_t)outcome;
+    record.lastPhase = (uint8_t)cyclePhase;
+    record.program = (uint8_t)cycleProgram;
+    record.imbalances = (uint8_t)(spinRedistributions + (spinRpmLimit != 0));
+    record.heatRate = (uint16_t)cycleHeatRate;
+    record.eco = cycleEco;
+    
+    uint32_t heaterJ = heaterEnergyJ - cycleHeaterStartJ;
+    uint32_t totalJ = heaterJ + (motorEnergyJ - cycleMotorStartJ);
+    uint32_t energy = (totalJ + JOULES_PER_ENERGY_UNIT / 2) / JOULES_PER_ENERGY_UNIT;
+    record.energy = (uint16_t)(energy > 0xFFFF ? 0xFFFF : energy);
+    logEvent(LOG_CYCLE_ENERGY, record.energy / 10, record.energy % 10,
+             totalJ != 0 ? (int)((uint64_t)heaterJ * 100 / totalJ) : 0);
+    
+    queueCycleRecord(record);
+}
+
+// Record a checkpointed cycle that a fault and the reset after it ended:
+// settings and time run from the checkpoint, energy unknown (boot)
+void recordCheckpointCycle(const CycleCheckpoint& cp, CycleOutcome outcome) {
+    CycleRecord record;
+    memset(&record, 0, sizeof(record));
+    record.duration_s = cp.elapsedMs / 1000;
+    record.minutes = cp.minutes;
+    record.rpm = cp.rpm;
+    record.load = cp.load;
+    record.temp = cp.temp;
+    record.loadClass = (uint8_t)classifyLoad(cp.load);
+    record.outcome = (uint8_t)outcome;
+    record.lastPhase = cp.phase;
+    record.program = cp.program;
+    queueCycleRecord(record);
+}
+
+void queueCycleRecord(const CycleRecord& record) {
+    {
+        CriticalSectionLock lock;
+        if (cycleLogPendingCount < CYCLE_LOG_BATCH) {
+            cycleLogPending[cycleLogPendingCount++] = record;
+        }
+    }
+    
+    // Flash work is allowed again once the cycle is over. Program the record
+    // now, a reset or power cut before the next flush would lose it.
+    cycleLogFlushAllowed = true;
+    requestCycleLogFlush();
+}
+
+// Have the telemetry thread write the queued records
+void requestCycleLogFlush() {
+    if (!cycleLogFlushPending.exchange(true)) {
+        telemetryQueue.call(flushCycleLog);
+    }
+}
+
+// Program the queued records (telemetry thread). Consecutive slots in one
+// sector go out as one program; entering a sector erases it first, dropping
+// the oldest records.
+void flushCycleLog() {
+    cycleLogFlushPending = false;
+    if (cycleLogEnd == 0 || !cycleLogFlushAllowed) {
+        return;
+    }
+    
+    CycleRecord batch[CYCLE_LOG_BATCH];
+    int count;
+    {
+        CriticalSectionLock lock;
+        count = cycleLogPendingCount;
+        memcpy(batch, cycleLogPending, count * sizeof(CycleRecord));
+        cycleLogPendingCount = 0;
+    }
+    
+    int done = 0;
+    while (done < count) {
+        // Sector holding the head
+        uint32_t sector = cycleLogStart;
+        while (sector + flash.get_sector_size(sector) <= cycleLogHead) {
+            sector += flash.get_sector_size(sector);
+        }
+        uint32_t sectorEnd = sector + flash.get_sector_size(sector);
+        if (cycleLogHead == sector) {
+            supervisionHeld = true;
+            flash.erase(sector, sectorEnd - sector);
+            supervisionHeld = false;
+        }
+        
+        int run = 0;
+        while (done + run < count && cycleLogHead + (run + 1) * sizeof(CycleRecord) <= sectorEnd) {
+            CycleRecord& record = batch[done + run];
+            record.seq = cycleLogSeq++;
+            record.checksum = cycleRecordChecksum(record);
+            run++;
+        }
+        flash.program(&batch[done], cycleLogHead, run * sizeof(CycleRecord));
+        
+        done += run;
+        cycleLogHead += run * sizeof(CycleRecord);
+        if (cycleLogHead >= cycleLogEnd) {
+            cycleLogHead = cycleLogStart;
+        }
+    }
+}
+
+// Byte sum of everything before the checksum field
+uint16_t cycleRecordChecksum(const CycleRecord& record) {
+    const uint8_t* bytes = (const uint8_t*)&record;
+    uint16_t sum = 0;
+    for (size_t i = 0; i < offsetof(CycleRecord, checksum); i++) {
+        sum += bytes[i];
+    }
+    return sum;
+}
+
+// Call visit(record) on the valid records, newest first, until it returns
+// false. Walks back from the head; a free slot or an older lap of the ring
+// ends the log.
+template<typename F>
+void forEachCycleRecord(F visit) {
+    uint32_t addr = cycleLogHead;
+    uint32_t prevSeq = cycleLogSeq;
+    uint32_t slots = (cycleLogEnd - cycleLogStart) / sizeof(CycleRecord);
+    
+    for (uint32_t i = 0; i < slots; i++) {
+        addr = (addr == cycleLogStart ? cycleLogEnd : addr) - sizeof(CycleRecord);
+        CycleRecord record;
+        flash.read(&record, addr, sizeof(record));
+        
+        if (record.seq == CYCLE_LOG_FREE || record.seq >= prevSeq) {
+            break;
+        }
+        prevSeq = record.seq;
+        if (record.checksum != cycleRecordChecksum(record) || record.outcome >= NUM_OUTCOMES) {
+            continue;
+        }
+        if (!visit(record)) {
+            break;
+        }
+    }
+}
+
+// Usage summary and the newest records (telemetry thread)
+void printCycleLog() {
+    if (cycleLogEnd == 0) {
+        printf("🗂️ Cycle log unavailable\n");
+        return;
+    }
+    
+    uint32_t total = 0;
+    uint32_t outcomes[NUM_OUTCOMES] = {0};
+    uint32_t energy = 0;
+    forEachCycleRecord([&](const CycleRecord& record) {
+        total++;
+        outcomes[record.outcome]++;
+        energy += record.energy;
+        if (total <= (uint32_t)CYCLE_LOG_DUMP) {
+            printf("  #%lu %s: program %u%s, %u min, %u RPM, %u°C, %s load, %u imbalances, ran %lu s (%s), %u.%u Wh\n",
+                   (unsigned long)record.seq, OUTCOME_NAMES[record.outcome], record.program, record.eco ? " eco" : "",
+                   record.minutes, record.rpm, record.temp, LOAD_CLASS_NAMES[record.loadClass % NUM_LOAD_CLASSES],
+                   record.imbalances, (unsigned long)record.duration_s, PHASE_NAMES[record.lastPhase % NUM_PHASES],
+                   record.energy / 10, record.energy % 10);
+        }
+        return true;
+    });
+    printf("🗂️ Cycle log: %lu cycles, %lu complete, %lu door aborts, %lu power offs, %lu cancelled, %lu faults, %lu.%lu Wh\n",
+           (unsigned long)total, (unsigned long)outcomes[OUTCOME_COMPLETE], (unsigned long)outcomes[OUTCOME_DOOR_ABORT],
+           (unsigned long)outcomes[OUTCOME_POWER_OFF], (unsigned long)outcomes[OUTCOME_CANCELLED], (unsigned long)outcomes[OUTCOME_FAULT],
+           (unsigned long)(energy / 10), (unsigned long)(energy % 10));
+}
+
+// Prior heating rate per load class: the mean of the class's newest
+// HEAT_HISTORY_CYCLES measured heat phases in the log, the default for a
+// class with none. The walk ends once every class is full or the log is.
+void loadHeatHistory() {
+    int sum[NUM_LOAD_CLASSES] = {0};
+    int count[NUM_LOAD_CLASSES] = {0};
+    int full = 0;   // Classes with HEAT_HISTORY_CYCLES measurements
+    if (cycleLogEnd != 0) {
+        forEachCycleRecord([&](const CycleRecord& record) {
+            int c = record.loadClass;
+            if (record.heatRate != 0 && c < NUM_LOAD_CLASSES && count[c] < HEAT_HISTORY_CYCLES) {
+                sum[c] += record.heatRate;
+                if (++count[c] == HEAT_HISTORY_CYCLES) {
+                    full++;
+                }
+            }
+            return full < NUM_LOAD_CLASSES;
+        });
+    }
+    for (int c = 0; c < NUM_LOAD_CLASSES; c++) {
+        heatRatePrior[c] = count[c] != 0 ? sum[c] / count[c] : HEAT_RATE_DEFAULTS[c];
+    }
+}
+
+// Programs in the table in use
+int programCount() {
+    return programTable.load()->header.count;
+}
+
+// Program by its 1-based number
+const WashProgram& programAt(int number) {
+    return programTable.load()->programs[number - 1];
+}
+
+// Cycle time a program runs for
+int programCycleMs(const WashProgram& program) {
+    int ms = 0;
+    for (int p = 0; p < NUM_PHASES; p++) {
+        ms += program.phases[p].durationS * MS_PER_CYCLE_MINUTE / 60;
+    }
+    return ms;
+}
+
+// Byte sum of the stored programs
+uint32_t programTableChecksum(const ProgramTable& table) {
+    const uint8_t* bytes = (const uint8_t*)table.programs;
+    uint32_t sum = 0;
+    for (size_t i = 0; i < table.header.count * sizeof(WashProgram); i++) {
+        sum += bytes[i];
+    }
+    return sum;
+}
+
+// Header, every program and the checksum must check out before the engine runs a table
+bool programTableValid(const ProgramTable& table) {
+    const ProgramTableHeader& header = table.header;
+    if (header.magic != PROGRAM_TABLE_MAGIC || header.version != PROGRAM_TABLE_VERSION ||
+        header.programSize != sizeof(WashProgram) || header.count < 1 || header.count > MAX_PROGRAMS) {
+        return false;
+    }
+    for (int i = 0; i < header.count; i++) {
+        if (!programWellFormed(table.programs[i])) {
+            return false;
+        }
+    }
+    return header.checksum == programTableChecksum(table);
+}
+
+// Use the uploaded table if the flash holds a valid one. Flash is memory
+// mapped, so the programs are read in place. The settings (programs and
+// calibration) take the smallest sector between the application image and
+// the cycle log, the one nearest the log if several tie.
+void initProgramTable() {
+    if (cycleLogStart == 0) {
+        return;
+    }
+    uint32_t best = 0;
+    for (uint32_t sector = flash.get_flash_start(); sector < cycleLogStart; sector += flash.get_sector_size(sector)) {
+        uint32_t size = flash.get_sector_size(sector);
+        if (sector >= FLASHIAP_APP_ROM_END_ADDR && size >= sizeof(ProgramTable) + sizeof(SensorCalibration) &&
+            (best == 0 || size <= flash.get_sector_size(best))) {
+            best = sector;
+        }
+    }
+    if (best == 0) {
+        return;   // No free sector: built-in programs and default calibration only
+    }
+    programTableAddr = best;
+    const ProgramTable* stored = (const ProgramTable*)(uintptr_t)programTableAddr;
+    if (programTableValid(*stored)) {
+        programTable = stored;
+    }
+}
+
+// List the programs, then the table as an upload line (telemetry thread)
+void printPrograms() {
+    const ProgramTable& table = *programTable.load();
+    printf("🧺 Programs (%s):\n", &table == &BUILTIN_PROGRAMS ? "built in" : "uploaded");
+    for (int i = 0; i < table.header.count; i++) {
+        const WashProgram& program = table.programs[i];
+        printf("  %d %-12.12s %2d min:", i + 1, program.name,
+               (programCycleMs(program) + MS_PER_CYCLE_MINUTE - 1) / MS_PER_CYCLE_MINUTE);
+        for (int p = 0; p < NUM_PHASES; p++) {
+            const ProgramPhase& step = program.phases[p];
+            printf(" %us/%uRPM/%u°C", step.durationS, step.rpm, step.tempC);
+        }
+        printf("\n");
+    }
+    
+    // The built-in table has no stored checksum
+    ProgramTableHeader header = table.header;
+    header.checksum = programTableChecksum(table);
+    printf("P");
+    const uint8_t* bytes = (const uint8_t*)&header;
+    for (size_t i = 0; i < sizeof(header); i++) {
+        printf("%02x", bytes[i]);
+    }
+    bytes = (const uint8_t*)table.programs;
+    for (size_t i = 0; i < table.header.count * sizeof(WashProgram); i++) {
+        printf("%02x", bytes[i]);
+    }
+    printf("\n");
+}
+
+// One character of a 'P' upload line (control thread)
+void receiveProgramUpload(char c) {
+    if (c == '\n' || c == '\r') {
+        if (programUploadNibbles != UPLOAD_DISCARD) {
+            finishProgramUpload();
+        }
+        programUploadNibbles = UPLOAD_IDLE;
+        return;
+    }
+    if (programUploadNibbles == UPLOAD_DISCARD) {
+        return;
+    }
+    
+    int nibble = c >= '0' && c <= '9' ? c - '0' :
+                 c >= 'a' && c <= 'f' ? c - 'a' + 10 :
+                 c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+    if (nibble < 0 || programUploadNibbles >= (int)sizeof(ProgramTable) * 2) {
+        logEvent(LOG_PROGRAMS_REJECTED, programUploadNibbles / 2);
+        programUploadNibbles = UPLOAD_DISCARD;
+        return;
+    }
+    uint8_t* bytes = (uint8_t*)&programUpload;
+    bytes[programUploadNibbles / 2] |= programUploadNibbles % 2 ? nibble : nibble << 4;
+    programUploadNibbles++;
+}
+
+// Check a complete upload and hand it to the telemetry thread for flashing.
+// Only in IDLE: the table stops being read while it is rewritten, and
+// SAVING_SETTINGS holds off a start until the erase stall is over.
+void finishProgramUpload() {
+    int bytes = programUploadNibbles / 2;
+    if (!inState(IDLE) || programWriteBusy || programTableAddr == 0) {
+        logEvent(LOG_PROGRAMS_BUSY);
+        return;
+    }
+    if (programUploadNibbles % 2 != 0 || bytes < (int)sizeof(ProgramTableHeader) ||
+        bytes != (int)(sizeof(ProgramTableHeader) + programUpload.header.count * sizeof(WashProgram)) ||
+        !programTableValid(programUpload)) {
+        logEvent(LOG_PROGRAMS_REJECTED, bytes);
+        return;
+    }
+    
+    programTable = &BUILTIN_PROGRAMS;
+    selectedProgram = MANUAL_PROGRAM;
+    programWriteBusy = true;
+    telemetryQueue.call(writeSettingsSector, false);
+    dispatchEvent(checkStartInhibit());
+}
+
+// Rewrite the program table sector: the table in programUpload if it is a
+// valid one, and the calibration record if there is one (telemetry thread)
+void writeSettingsSector(bool calibrationSave) {
+    uint32_t size = sizeof(ProgramTableHeader) + programUpload.header.count * sizeof(WashProgram);
+    uint32_t page = flash.get_page_size();
+    size = (size + page - 1) / page * page;
+    
+    supervisionHeld = true;
+    bool ok = flash.erase(programTableAddr, flash.get_sector_size(programTableAddr)) == 0;
+    supervisionHeld = false;
+    if (ok && programTableValid(programUpload)) {
+        ok = flash.program(&programUpload, programTableAddr, size) == 0;
+    }
+    // 16 bytes is a whole number of pages for any page size up to 16
+    if (ok && calibration.magic == CALIBRATION_MAGIC) {
+        ok = flash.program(&calibration, calibrationAddr(), sizeof(calibration)) == 0;
+    }
+    if (calibrationSave) {
+        controlQueue.call(onCalibrationWritten, ok);
+    } else {
+        controlQueue.call(onProgramTableWritten, ok);
+    }
+}
+
+// Switch to the written table once it reads back valid (control thread)
+void onProgramTableWritten(bool ok) {
+    programWriteBusy = false;
+    const ProgramTable* stored = (const ProgramTable*)(uintptr_t)programTableAddr;
+    if (!ok || !programTableValid(*stored)) {
+        logEvent(LOG_PROGRAMS_WRITE_FAILED);
+    } else {
+        programTable = stored;
+        logEvent(LOG_PROGRAMS_LOADED, stored->header.count);
+    }
+    dispatchEvent(EV_SETTINGS_SAVED);
+}
+
+// Calibration record, in the last bytes of the program table sector
+uint32_t calibrationAddr() {
+    return programTableAddr + flash.get_sector_size(programTableAddr) - sizeof(SensorCalibration);
+}
+
+// Byte sum of the record up to its checksum
+uint16_t calibrationChecksum(const SensorCalibration& cal) {
+    const uint8_t* bytes = (const uint8_t*)&cal;
+    uint16_t sum = 0;
+    for (size_t i = 0; i < offsetof(SensorCalibration, checksum); i++) {
+        sum += bytes[i];
+    }
+    return sum;
+}
+
+// A record is only used with its magic, its checksum and values the fit could produce
+bool calibrationValid(const SensorCalibration& cal) {
+    return cal.magic == CALIBRATION_MAGIC && cal.checksum == calibrationChecksum(cal) &&
+           cal.doorThreshold < LIGHT_FULL_SCALE &&
+           cal.tempFullScale >= TEMP_FULL_SCALE * TEMP_GAIN_MIN_PERCENT / 100 &&
+           cal.tempFullScale <= TEMP_FULL_SCALE * TEMP_GAIN_MAX_PERCENT / 100;
+}
+
+// Sensor processing picks the values up on its next tick
+void applyCalibration(const SensorCalibration& cal) {
+    doorOpenThreshold = cal.doorThreshold;
+    tempFullScale = cal.tempFullScale;
+}
+
+// Use the stored calibration, if the sensors have been calibrated
+void initCalibration() {
+    if (programTableAddr == 0) {
+        return;
+    }
+    const SensorCalibration* stored = (const SensorCalibration*)(uintptr_t)calibrationAddr();
+    if (calibrationValid(*stored)) {
+        calibration = *stored;
+        applyCalibration(calibration);
+        logEvent(LOG_CALIBRATION_LOADED, calibration.doorThreshold,
+                 (int)(calibration.tempFullScale * 100 / TEMP_FULL_SCALE));
+    }
+}
+
+// Write a new calibration with the stored table (control thread). Like an
+// upload, the table isn't read while its sector is erased.
+void saveCalibration(const SensorCalibration& cal) {
+    if (programTableAddr == 0 || programWriteBusy) {
+        logEvent(LOG_CALIBRATION_NOT_SAVED);
+        return;
+    }
+    if (programUploadNibbles != UPLOAD_IDLE) {
+        logEvent(LOG_PROGRAMS_BUSY);
+        programUploadNibbles = UPLOAD_DISCARD;
+    }
+    const ProgramTable* stored = (const ProgramTable*)(uintptr_t)programTableAddr;
+    memcpy(&programUpload, stored, sizeof(programUpload));
+    if (programTable.load() == stored) {
+        programTable = &BUILTIN_PROGRAMS;
+        selectedProgram = MANUAL_PROGRAM;
+    }
+    calibration = cal;
+    programWriteBusy = true;
+    telemetryQueue.call(writeSettingsSector, true);
+}
+
+// Back to the stored table once the sector is rewritten (control thread)
+void onCalibrationWritten(bool ok) {
+    programWriteBusy = false;
+    const ProgramTable* stored = (const ProgramTable*)(uintptr_t)programTableAddr;
+    if (programTableValid(*stored)) {
+        programTable = stored;
+    }
+    if (!ok || !calibrationValid(*(const SensorCalibration*)(uintptr_t)calibrationAddr())) {
+        logEvent(LOG_CALIBRATION_NOT_SAVED);
+    }
+    dispatchEvent(EV_SETTINGS_SAVED);
+}
+
+// Send new display contents to the UI thread (the control thread never touches segDis)
+void postDisplayFrames(const uint8_t* frames, int count) {
+    DisplayFrames msg;
+    msg.count = count > DISPLAY_MAX_FRAMES ? DISPLAY_MAX_FRAMES : count;
+    memcpy(msg.frames, frames, msg.count);
+    uiQueue.call(setDisplayFrames, msg);
+}
+
+// Replace the framebuffer contents (UI thread)
+void setDisplayFrames(DisplayFrames msg) {
+    // Same layout keeps its position, so a ticking value does not restart the sequence
+    if (msg.count != displayFrameCount) {
+        displayFrameIndex = 0;
+        displayTick = 0;
+    }
+    memcpy(displayFrames, msg.frames, msg.count);
+    displayFrameCount = msg.count;
+}
+
+// Empty framebuffer, display stays blank (UI thread)
+void clearDisplay() {
+    displayFrameCount = 0;
+    displayFrameIndex = 0;
+    displayTick = 0;
+}
+
+// Remaining cycle time as MM-SS, MMM-SS from 100 minutes (heavy hot plans
+// and heat holds run past the two digits)
+void showTimeRemaining(int seconds) {
+    int minutes = seconds / 60;
+    int secs = seconds % 60;
+    uint8_t frames[DISPLAY_MAX_FRAMES];
+    int count = 0;
+    if (minutes >= 100) {
+        frames[count++] = (uint8_t)hexDis[minutes / 100 % 10];
+    }
+    frames[count++] = (uint8_t)hexDis[minutes / 10 % 10];
+    frames[count++] = (uint8_t)hexDis[minutes % 10];
+    frames[count++] = SEG_DASH;
+    frames[count++] = (uint8_t)hexDis[secs / 10];
+    frames[count++] = (uint8_t)hexDis[secs % 10];
+    frames[count++] = SEG_BLANK;
+    postDisplayFrames(frames, count);
+}
+
+// Settings as time (minutes) - RPM (hundreds) - temp (tens of °C)
+void showSettings(int time, int rpm, int temp) {
+    uint8_t frames[] = {
+        (uint8_t)hexDis[time / 10 % 10], (uint8_t)hexDis[time % 10], SEG_DASH,
+        (uint8_t)hexDis[rpm / 100 % 10], SEG_DASH,
+        (uint8_t)hexDis[temp / 10 % 10], SEG_BLANK
+    };
+    postDisplayFrames(frames, sizeof(frames));
+}
+
+// Selected wash program as P<number> - minutes
+void showProgram(int number, int minutes) {
+    uint8_t frames[] = {
+        SEG_P, (uint8_t)hexDis[number % 10], SEG_DASH,
+        (uint8_t)hexDis[minutes / 10 % 10], (uint8_t)hexDis[minutes % 10], SEG_BLANK
+    };
+    postDisplayFrames(frames, sizeof(frames));
+}
+
+// Power on the system
+MachineEvent powerOn() {
+    lastReading = SensorSnapshot();
+    
+    // Start with an empty ADC ring buffer, before the UI restarts sampling
+    safetyQueue.call(resetSensing);
+    uiQueue.call(uiPowerOn);
+    
+    playBeep(600, 100);
+    logEvent(LOG_POWER_ON);
+    
+    // A cycle cut short by a power loss can be picked up again
+    if (resumeAvailable) {
+        logEvent(LOG_RESUME_OFFER, checkpointRemainingMs(resumeCheckpoint) / MS_PER_CYCLE_MINUTE);
+    }
+    // A settings write from before the power off may still be running
+    return checkStartInhibit();
+}
+
+// Power button while a cycle runs or is paused
+MachineEvent powerOffMidCycle() {
+    recordCycle(OUTCOME_POWER_OFF);
+    return powerOff();
+}
+
+// System power off
+MachineEvent powerOff() {
+    // Switching off on purpose abandons the cycle (and any resume offer)
+    clearCheckpoint();
+    setPidSetpoints(0, 0);
+    
+    // Queued cycle records go to flash before standby
+    requestCycleLogFlush();
+    playBeep(600, 100);
+    logEvent(LOG_POWER_OFF);
+    
+    // Outputs off, then standby once the off beep has played
+    uiQueue.call(uiPowerOff);
+    return EV_NONE;
+}
+
+// UI side of power on: leave standby and set up the RGB PWM (UI thread)
+void uiPowerOn() {
+    uiPowered = true;
+    exitStandby();
+    
+    // Initialize PWM
+    rgbRed.period(1.0f/FREQUENCY);
+    rgbGreen.period(1.0f/FREQUENCY); 
+    rgbBlue.period(1.0f/FREQUENCY);
+}
+
+// UI side of power off: reset outputs and drop into standby (UI thread)
+void uiPowerOff() {
+    uiPowered = false;
+    setRGB(0, 0, 0);
+    redLED = 0;
+    clearDisplay();
+    segDis = SEG_BLANK;
+    enterStandby();
+}
+
+// Start sensor sampling and display refresh (the sensor reports drive the cycle tick)
+void startPeriodicEvents() {
+    superviseTask(TASK_SAFETY, true);
+    superviseTask(TASK_CONTROL, true);
+    safetyEventId = safetyQueue.call_every(std::chrono::milliseconds(CONTROL_PERIOD_MS), safetyTick);
+    displayEventId = uiQueue.call_every(std::chrono::milliseconds(DISPLAY_PERIOD_MS), refreshDisplay);
+}
+
+// Stop all periodic events so the queues have nothing left to wake for
+void stopPeriodicEvents() {
+    superviseTask(TASK_SAFETY, false);
+    superviseTask(TASK_CONTROL, false);
+    if (safetyEventId) {
+        safetyQueue.cancel(safetyEventId);
+        safetyEventId = 0;
+    }
+    if (displayEventId) {
+        uiQueue.cancel(displayEventId);
+        displayEventId = 0;
+    }
+}
+
+// Shut down outputs so the idle thread can reach deep sleep (stop mode).
+// Wake sources left armed: the power button EXTI, the serial RX interrupt
+// and the low-power supervisor ticker. The other buttons are only polled
+// by the stopped sampler, so they cannot wake the chip. (UI thread)
+void enterStandby() {
+    if (uiPowered || standbyActive) {
+        return;
+    }
+    
+    // Let a queued beep finish before the buzzer PWM goes down
+    if (buzzerBusy) {
+        uiQueue.call_in(std::chrono::milliseconds(STANDBY_RETRY_MS), enterStandby);
+        return;
+    }
+    
+    stopPeriodicEvents();
+    stopPid();
+    
+    // A power press the sampler has not registered yet has had its falling
+    // edge, so it could not wake the sampler again: sample it as a wake.
+    // The held press that switched off is already registered.
+    {
+        CriticalSectionLock lock;
+        bool unseenPress = powerButton.read() == 0 && !buttons[BUTTON_POWER].pressed;
+        stopButtonSampling();
+        if (unseenPress) {
+            powerButtonWake();
+        }
+    }
+    segDis = SEG_BLANK;
+    
+    // PWM holds a deep sleep lock while running
+    heater.suspend();
+    motor.suspend();
+    buzzer.suspend();
+    rgbRed.suspend();
+    rgbGreen.suspend();
+    rgbBlue.suspend();
+    
+    standbyActive = true;
+}
+
+// Bring outputs back up after a wake (UI thread)
+void exitStandby() {
+    if (!standbyActive) {
+        return;
+    }
+    
+    heater.resume();
+    motor.resume();
+    buzzer.resume();
+    rgbRed.resume();
+    rgbGreen.resume();
+    rgbBlue.resume();
+    
+    // Standby time is not tick jitter
+    lastTickStart = 0;
+    startPeriodicEvents();
+    startPid();
+    standbyActive = false;
+}
+
+// Sensor Processing (safety thread): sample, detect, report to control
+void readAndProcessSensors() {
+    ScopedTiming timing(TIME_SENSORS);
+    
+    // One conversion per channel, results land in the ring buffer
+    scanAdcChannels();
+    
+    // Pot settings from the lookup tables
+    int rpm = potToRpm(readAdcRaw(ADC_RPM));
+    int temp = potToTemp(readAdcRaw(ADC_TEMP_SET));
+    int time = potToTime(readAdcRaw(ADC_TIME));
+
+    // Filtered sensor readings in fixed-point units
+    int fsr = scaleRaw(readAdcRaw(ADC_FSR), LOAD_FULL_SCALE);
+    int ldr = scaleRaw(readAdcRaw(ADC_LDR), LIGHT_FULL_SCALE);
+    int tempActual = scaleRaw(readAdcRaw(ADC_TEMP), tempFullScale);
+    
+    // Check for significant changes in pots 
+    if (hasSignificantChange(rpm, prevRpm, 50) || 
+        hasSignificantChange(temp, prevTemp, 5) || 
+        hasSignificantChange(time, prevTime, 5)) {
+        
+        logSettings(rpm, temp, time);
+        prevRpm = rpm;
+        prevTemp = temp;
+        prevTime = time;
+    }
+
+    // Check for significant changes in sensor readings
+    if (hasSignificantChange(fsr, prevFsr, FSR_THRESHOLD) || 
+        hasSignificantChange(tempActual, prevTempActual, TEMP_THRESHOLD) || 
+        hasSignificantChange(ldr, prevLdr, LDR_THRESHOLD)) {
+        
+        logSensors(fsr, tempActual, ldr, isDoorOpen(ldr));
+        prevFsr = fsr;
+        prevTempActual = tempActual;
+        prevLdr = ldr;
+    }
+
+    // Door and overload state
+    doorOpenWarningActive = debounceDoor(isDoorOpen(ldr));
+    overloadWarningActive = isOverloaded(fsr);
+    
+    SensorSnapshot snapshot;
+    snapshot.time_ms = (uint32_t)Kernel::Clock::now().time_since_epoch().count();
+    snapshot.rpm = rpm;
+    snapshot.temp = temp;
+    snapshot.time = time;
+    snapshot.load = fsr;
+    snapshot.light = ldr;
+    snapshot.tempActual = tempActual;
+    snapshot.doorOpen = doorOpenWarningActive;
+    snapshot.overloaded = overloadWarningActive;
+    publishSnapshot(snapshot);
+    
+    // The control thread reacts to the latest snapshot, one report in flight at most
+    if (!sensorReportPending.exchange(true)) {
+        controlQueue.call(onSensorReading);
+    }
+    
+    // After the report, so the control thread sees the door before the fault
+    checkOutputFaults(tempActual);
+}
+
+// Publish a new snapshot (safety thread only)
+void publishSnapshot(const SensorSnapshot& snapshot) {
+    uint32_t seq = snapshotSeq.load(std::memory_order_relaxed);
+    snapshotSeq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    snapshotData = snapshot;
+    snapshotSeq.store(seq + 2, std::memory_order_release);
+}
+
+// Copy the latest snapshot, false if a write was in progress or overlapped
+// the copy. Safe from ISRs: never waits for the writer.
+bool tryReadSnapshot(SensorSnapshot& out) {
+    uint32_t before = snapshotSeq.load(std::memory_order_acquire);
+    if (before & 1) {
+        return false;
+    }
+    out = snapshotData;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return snapshotSeq.load(std::memory_order_relaxed) == before;
+}
+
+// Copy the latest snapshot, retrying until consistent (threads only: an ISR
+// that interrupted the writer would spin forever)
+void readSnapshot(SensorSnapshot& out) {
+    while (!tryReadSnapshot(out)) {
+    }
+}
+
+// Fresh detection state for a power on (safety thread)
+void resetSensing() {
+    resetAdcScan();
+    publishSnapshot(SensorSnapshot());
+    doorOpenWarningActive = false;
+    overloadWarningActive = false;
+    doorOpenCount = 0;
+    doorClosedCount = 0;
+}
+
+// Periodic safety tick (safety thread)
+void safetyTick() {
+    // Tick-to-tick period, its spread is the scheduling jitter
+    uint32_t now = readCycleCounter();
+    if (lastTickStart != 0) {
+        recordTiming(TIME_TICK_INTERVAL, now - lastTickStart);
+    }
+    lastTickStart = now;
+    
+    readAndProcessSensors();
+    watchVibration();
+    checkIn(TASK_SAFETY);
+}
+
+// Tune a Goertzel filter to the drum frequency (rpm / 60 Hz) and clear it
+void goertzelInit(Goertzel& g, int rpm) {
+    float w = 2.0f * 3.14159265f * rpm / (60.0f * VIBRATION_RATE_HZ);
+    g.coeff = (int32_t)(2.0f * cosf(w) * (1 << GOERTZEL_FRAC_BITS));
+    g.s1 = 0;
+    g.s2 = 0;
+}
+
+// One sample through the filter: s = x + coeff × s1 - s2
+void goertzelStep(Goertzel& g, int32_t sample) {
+    int32_t s = sample + (int32_t)(((int64_t)g.coeff * g.s1) >> GOERTZEL_FRAC_BITS) - g.s2;
+    g.s2 = g.s1;
+    g.s1 = s;
+}
+
+// Squared magnitude of the bin after a block
+int64_t goertzelPower(const Goertzel& g) {
+    return (int64_t)g.s1 * g.s1 + (int64_t)g.s2 * g.s2 - ((((int64_t)g.coeff * g.s1) >> GOERTZEL_FRAC_BITS) * g.s2);
+}
+
+// Start the 1 kHz FSR capture once the drum is set to spin (safety thread)
+void watchVibration() {
+    int rpm = motorSetpoint.load(std::memory_order_relaxed);
+    if (vibrationEventId != 0 || rpm < VIBRATION_MIN_RPM) {
+        return;
+    }
+    vibrationMean = -1;
+    vibrationHits = 0;
+    vibrationReported = false;
+    startVibrationBlock(rpm);
+    vibrationEventId = safetyQueue.call_every(std::chrono::milliseconds(VIBRATION_SAMPLE_MS), sampleVibration);
+}
+
+// New Goertzel block at the current drum setpoint, which moves during the ramp
+void startVibrationBlock(int rpm) {
+    vibrationRpm = rpm;
+    goertzelInit(vibrationFilter, rpm);
+    vibrationSamples = 0;
+    vibrationSum = 0;
+}
+
+// One FSR sample, and the imbalance check at the end of a block. Stops
+// itself when the drum drops below spin speed. (safety thread)
+void sampleVibration() {
+    int rpm = motorSetpoint.load(std::memory_order_relaxed);
+    if (rpm < VIBRATION_MIN_RPM) {
+        safetyQueue.cancel(vibrationEventId);
+        vibrationEventId = 0;
+        return;
+    }
+    
+    // 12-bit sample with the previous block's mean (the static load) taken off
+    int32_t sample = fsrSensor.read_u16() >> 4;
+    vibrationSum += sample;
+    goertzelStep(vibrationFilter, vibrationMean < 0 ? 0 : sample - vibrationMean);
+    if (++vibrationSamples < VIBRATION_BLOCK) {
+        return;
+    }
+    
+    bool over = vibrationMean >= 0 && goertzelPower(vibrationFilter) > VIBRATION_POWER_LIMIT;
+    vibrationHits = over ? vibrationHits + 1 : 0;
+    vibrationMean = vibrationSum / VIBRATION_BLOCK;
+    if (vibrationHits >= VIBRATION_CONFIRM_BLOCKS && !vibrationReported) {
+        vibrationReported = true;
+        controlQueue.call(onImbalance, vibrationRpm);
+    }
+    startVibrationBlock(rpm);
+}
+
+// Imbalance report from the safety thread (control thread)
+void onImbalance(int rpm) {
+    imbalanceRpm = rpm;
+    dispatchEvent(EV_IMBALANCE);
+}
+
+// New sensor snapshot from the safety thread (control thread)
+void onSensorReading() {
+    sensorReportPending = false;
+    checkIn(TASK_CONTROL);
+    
+    // Reports already queued when the power went off
     if (systemState == OFF) {
-        segDis = 0x00;  // Display off when system off
+        return;
+    }
+    
+    SensorSnapshot reading;
+    readSnapshot(reading);
+    SensorSnapshot previous = lastReading;
+    lastReading = reading;
+    
+    // Door and load changes first, so the report is handled in the state they lead to
+    if (reading.doorOpen != previous.doorOpen) {
+        dispatchEvent(reading.doorOpen ? EV_DOOR_OPENED : EV_DOOR_CLOSED);
+    }
+    if (reading.overloaded != previous.overloaded) {
+        dispatchEvent(reading.overloaded ? EV_OVERLOAD : EV_LOAD_OK);
+    }
+    dispatchEvent(EV_SENSOR_REPORT);
+    
+    // Update RGB based on load level
+    uiQueue.call(setLoadLevelColor, (int)reading.load);
+}
+
+// Show the current settings (or the selected program), or the time an
+// offered resume has left, and the door on its LED (IDLE and its faults)
+MachineEvent showIdleStatus() {
+    if (resumeAvailable) {
+        showTimeRemaining(checkpointRemainingMs(resumeCheckpoint) * 60 / MS_PER_CYCLE_MINUTE);
+    } else if (selectedProgram != MANUAL_PROGRAM) {
+        showProgram(selectedProgram, programCycleMs(programAt(selectedProgram)) / MS_PER_CYCLE_MINUTE);
     } else {
-        segDis = hexDis[value % 10];
+        showSettings(lastReading.time, lastReading.rpm, lastReading.temp);
     }
+    uiQueue.call(setDoorLed, (bool)lastReading.doorOpen);
+    return EV_NONE;
 }
 
-// Power on the system
-void powerOn() {
-    systemState = IDLE;
-    playBeep(600, 100);
-    printf("🟢 [System On]\n");
-    
-    // Initialize PWM
-    rgbRed.period(1.0f/FREQUENCY);
-    rgbGreen.period(1.0f/FREQUENCY); 
-    rgbBlue.period(1.0f/FREQUENCY);
+// Frozen cycle time and the door LED while PAUSED
+MachineEvent showPausedStatus() {
+    showTimeRemaining(estimateRemainingMs(pausedElapsedMs) * 60 / MS_PER_CYCLE_MINUTE);
+    uiQueue.call(setDoorLed, (bool)lastReading.doorOpen);
+    return EV_NONE;
 }
 
-// System power off
-void powerOff() {
-    systemState = OFF;
-    playBeep(600, 100);
-    printf("🔴 [System Off]\n");
-    
-    // Reset outputs
-    setRGB(0, 0, 0);
-    redLED = 0;
-    updateDisplay(0);
+// Door opened with the drum stopped
+MachineEvent doorOpenedBeep() {
+    playBeep(700, 200);
+    return EV_NONE;
+}
+
+MachineEvent warnOverload() {
+    logEvent(LOG_OVERLOAD);
+    playBeep(500, 100);
+    return EV_NONE;
+}
+
+MachineEvent reportLoadOk() {
+    logEvent(LOG_LOAD_OK);
+    return EV_NONE;
+}
+
+// Load back under the limit in OVERLOAD_FAULT, IDLE checks what else holds the start
+MachineEvent clearOverload() {
+    reportLoadOk();
+    return checkStartInhibit();
+}
+
+// Entering IDLE with a start condition still failing goes on to its fault.
+// A settings write erases flash for up to FLASH_ERASE_MAX_MS, so no cycle
+// may start under it.
+MachineEvent checkStartInhibit() {
+    if (lastReading.doorOpen) {
+        return EV_DOOR_STILL_OPEN;
+    }
+    if (lastReading.overloaded) {
+        return EV_STILL_OVERLOADED;
+    }
+    if (programWriteBusy) {
+        return EV_STILL_SAVING;
+    }
+    return EV_NONE;
+}
+
+// Run an event and its completion events through TRANSITION_TABLE: one
+// lookup each, the action on the way, then the new state. Control thread
+// only, other threads post their events to controlQueue.
+void dispatchEvent(MachineEvent event) {
+    // Worst chain: a report and a phase end for every phase, then the end
+    for (int hops = 0; event != EV_NONE && hops < 2 * NUM_PHASES + 4; hops++) {
+        SystemState next = TRANSITION_TABLE.next[systemState][event];
+        if (next == NO_STATE) {
+            return;
+        }
+        TransitionAction action = TRANSITION_TABLE.action[systemState][event];
+        event = action != nullptr ? action() : EV_NONE;
+        if (next != STAY) {
+            systemState = next;
+        }
+    }
+}
+
+// True in a state or any state nested in it
+bool inState(SystemState state) {
+    for (SystemState s = systemState; s != NO_STATE; s = STATE_INFO[s].parent) {
+        if (s == state) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Periodic display refresh: time-multiplexes the framebuffer onto the
+// single digit, each digit lit for DISPLAY_DIGIT_TICKS then one blank tick
+// so repeated digits stay readable
+void refreshDisplay() {
+    if (displayFrameCount == 0) {
+        segDis = SEG_BLANK;
+        return;
+    }
     
-    // Reset variables
-    doorOpenWarningActive = false;
-    overloadWarningActive = false;
+    if (displayTick < DISPLAY_DIGIT_TICKS) {
+        segDis = displayFrames[displayFrameIndex];
+        displayTick++;
+    } else {
+        segDis = SEG_BLANK;
+        displayTick = 0;
+        displayFrameIndex = (displayFrameIndex + 1) % displayFrameCount;
+    }
 }
 
-// Sensor Processing
-void readAndProcessSensors() {
-    // Read potentiometers and scale values
-    int rpm = (int)(potRPM.read() * 7.0f + 2.0f) * 100;  // 2-9 × 100
-    int temp = (int)(potTemp.read() * 4.0f + 2.0f) * 10; // 2-6 × 10
+// Sample every button from a fresh released state
+void startButtonSampling() {
+    for (int i = 0; i < NUM_BUTTONS; i++) {
+        buttons[i].history = 0xFF;
+        buttons[i].pressed = false;
+        buttons[i].longSent = false;
+        buttons[i].heldMs = 0;
+    }
+    buttonsSampling = true;
+    buttonTicker.attach(&sampleButtons, std::chrono::microseconds(BUTTON_SAMPLE_US));
+}
+
+// Stop sampling for standby, the power button edge interrupt restarts it
+void stopButtonSampling() {
+    buttonTicker.detach();
+    buttonsSampling = false;
+}
+
+// Power button edge while the sampler is stopped (ISR). The sampler only
+// runs in standby with the machine OFF, so until it sees a press.
+void powerButtonWake() {
+    if (!buttonsSampling) {
+        startButtonSampling();
+        buttonWakeMs = 0;
+        buttonWakePending = true;
+    }
+}
+
+// 1 ms sampler (timer ISR)
+void sampleButtons() {
+    for (int i = 0; i < NUM_BUTTONS; i++) {
+        sampleInput(buttons[i]);
+    }
     
-    // Calculate time (N × 10 minutes)
-    float potVal = potTime.read();
-    int time = static_cast<int>(roundf(potVal * 8.0f)) + 1;
-    time = time > 9 ? 9 : time;
-    time *= 10;
+    // A real press powers on, which keeps the sampler. An edge that never
+    // debounces into one (noise, a release bounce) goes back to stop mode.
+    if (buttonWakePending) {
+        if (buttons[BUTTON_POWER].pressed) {
+            buttonWakePending = false;
+        } else if (++buttonWakeMs >= (uint32_t)BUTTON_WAKE_MS) {
+            buttonWakePending = false;
+            stopButtonSampling();
+        }
+    }
+}
 
-    // Read sensors using averaging function
-    float fsr = readAveragedSensor(fsrSensor);
-    float ldr = readAveragedSensor(ldrSensor, 100.0f);
-    float tempActual = readAveragedSensor(tempSensor, 330.0f) * TEMP_SENSOR_CALIBRATION;
+// Shift in one sample and post any edge or long press to the control queue (ISR)
+void sampleInput(DebouncedInput& input) {
+    input.history = (uint8_t)((input.history << 1) | (input.read() ? 1 : 0));
+    uint8_t stable = input.history & BUTTON_STABLE_MASK;
     
+    if (!input.pressed && stable == 0) {
+        input.pressed = true;
+        input.longSent = false;
+        input.heldMs = 0;
+        controlQueue.call(onButtonEvent, input.id, BUTTON_PRESSED, (uint32_t)0);
+    } else if (input.pressed && stable == BUTTON_STABLE_MASK) {
+        input.pressed = false;
+        controlQueue.call(onButtonEvent, input.id, BUTTON_RELEASED, input.heldMs);
+    } else if (input.pressed) {
+        input.heldMs += BUTTON_SAMPLE_US / 1000;
+        if (!input.longSent && input.heldMs >= (uint32_t)LONG_PRESS_MS) {
+            input.longSent = true;
+            controlQueue.call(onButtonEvent, input.id, BUTTON_LONG_PRESS, input.heldMs);
+        }
+    }
+}
+
+// Debounced button events (control thread). Power acts on the press; start
+// acts on a short press' release, so a long press never also starts a cycle.
+void onButtonEvent(ButtonId id, ButtonEvent event, uint32_t heldMs) {
+    MachineEvent machineEvent;
+    if (id == BUTTON_POWER && event == BUTTON_PRESSED) {
+        machineEvent = EV_POWER;
+    } else if (id == BUTTON_START && event == BUTTON_RELEASED && heldMs < (uint32_t)LONG_PRESS_MS) {
+        machineEvent = EV_START;
+    } else if (id == BUTTON_START && event == BUTTON_LONG_PRESS) {
+        machineEvent = EV_LONG_PRESS;
+    } else {
+        return;
+    }
     
-    // Update display with current time setting in IDLE mode
-    if (systemState == IDLE) {
-        updateDisplay(time / 10);
+    ScopedTiming timing(TIME_BUTTONS);
+    dispatchEvent(machineEvent);
+}
+
+// Start press in IDLE: an offered resume, or a new cycle of the selected
+// program (the pot settings for MANUAL_PROGRAM). Ignored until the first
+// sensor report since power on, the pots and door are not read before it.
+MachineEvent startOrResumeCycle() {
+    if (lastReading.time_ms == 0) {
+        return EV_NONE;
+    }
+    if (resumeAvailable) {
+        return resumeCycle();
     }
     
-    // Check for significant changes in pots 
-    if (hasSignificantChange(rpm, prevRpm, 50) || 
-        hasSignificantChange(temp, prevTemp, 5) || 
-        hasSignificantChange(time, prevTime, 5)) {
+    if (selectedProgram != MANUAL_PROGRAM) {
+        planProgramCycle(selectedProgram, lastReading.load);
+        logEvent(LOG_CYCLE_START, cycleRpm, cycleTemp, cycleMinutes);
+    } else {
+        // Settings from the latest sensor report
+        int rpm = lastReading.rpm;
+        int temp = lastReading.temp;
+        int time = lastReading.time;
         
-        printf("⚙️ RPM: %d | 🌡️ Temp Set: %d°C | ⏱️ Time: %d min\n", rpm, temp, time);
-        prevRpm = rpm;
-        prevTemp = temp;
-        prevTime = time;
+        logEvent(LOG_CYCLE_START, rpm, temp, time);
+        planManualCycle(time, rpm, temp, lastReading.load);
+    }
+    playBeep(700, 100);
+    
+    // Cycle engine takes over from the control tick
+    beginCycle(0);
+    return EV_CYCLE_STARTED;
+}
+
+// Start/pause held in IDLE: the next wash program, after the last one back to the pots
+MachineEvent selectNextProgram() {
+    selectProgram((selectedProgram + 1) % (programCount() + 1));
+    return EV_NONE;
+}
+
+// Select a program (0 to programCount()) for the next start
+void selectProgram(int number) {
+    selectedProgram = number;
+    if (selectedProgram == MANUAL_PROGRAM) {
+        logEvent(LOG_PROGRAM_MANUAL);
+    } else {
+        int minutes = (programCycleMs(programAt(selectedProgram)) + MS_PER_CYCLE_MINUTE - 1) / MS_PER_CYCLE_MINUTE;
+        logEvent(LOG_PROGRAM_SELECTED, selectedProgram, minutes);
     }
+    playBeep(800, 50);
+}
 
-    // Check for significant changes in sensor readings
-    if (hasSignificantChange(fsr, prevFsr, FSR_THRESHOLD) || 
-        hasSignificantChange(tempActual, prevTempActual, TEMP_THRESHOLD) || 
-        hasSignificantChange(ldr, prevLdr, LDR_THRESHOLD)) {
-        
-        int displayTemp = round(tempActual);
-        bool doorIsOpen = isDoorOpen();
-        const char* doorStatus = doorIsOpen ? "Door Open" : "Door Closed";
-        
-        printf("📦 Load: %.2f | 🌡️ Temp: %d°C | 🚪 %s\n", fsr, displayTemp, doorStatus);
-        prevFsr = fsr;
-        prevTempActual = tempActual;
-        prevLdr = ldr;
+// Calibration requested in IDLE: prompt for the door closed level first
+MachineEvent startCalibration() {
+    calibrationStep = CAL_DOOR_CLOSED;
+    calibrationSamples = -1;
+    logEvent(LOG_CALIBRATE_CLOSED);
+    playBeep(800, 50);
+    showCalibrationStep();
+    return EV_NONE;
+}
+
+// Start pressed: average the next CALIBRATION_SAMPLES reports for the step
+MachineEvent sampleCalibration() {
+    if (calibrationSamples < 0) {
+        calibrationSamples = 0;
+        calibrationSum = 0;
     }
+    return EV_NONE;
+}
 
-    // Door State
-    bool currentDoorReading = isDoorOpen();
+// Add a report to the step being sampled. A finished step prompts the next
+// one, or repeats when its levels can't be told apart.
+MachineEvent updateCalibration() {
+    showCalibrationStep();
+    if (calibrationSamples < 0) {
+        return EV_NONE;
+    }
+    calibrationSum += calibrationStep == CAL_TEMPERATURE ? lastReading.tempActual : lastReading.light;
+    if (++calibrationSamples < CALIBRATION_SAMPLES) {
+        return EV_NONE;
+    }
+    int average = calibrationSum / CALIBRATION_SAMPLES;
+    calibrationSamples = -1;
     
-    if (currentDoorReading) {
-        doorOpenCount++;
-        doorClosedCount = 0;
+    if (calibrationStep == CAL_DOOR_CLOSED) {
+        calibrationClosedLight = average;
+        calibrationStep = CAL_DOOR_OPEN;
+        logEvent(LOG_CALIBRATE_OPEN);
+    } else if (calibrationStep == CAL_DOOR_OPEN) {
+        calibrationOpenLight = average;
+        if (calibrationOpenLight - calibrationClosedLight < CALIBRATION_MIN_CONTRAST) {
+            logEvent(LOG_CALIBRATION_DOOR_FAILED, calibrationClosedLight, calibrationOpenLight);
+            calibrationStep = CAL_DOOR_CLOSED;
+            logEvent(LOG_CALIBRATE_CLOSED);
+            playBeep(300, 500);
+            return EV_NONE;
+        }
+        calibrationStep = CAL_TEMPERATURE;
+        calibrationRefC = 0;
+        logEvent(LOG_CALIBRATE_TEMP);
     } else {
-        doorClosedCount++;
-        doorOpenCount = 0;
+        // Sensor gain scales with the reading: full scale × reference / measured
+        calibrationFullScale = tempFullScale;
+        if (calibrationRefC == 0) {
+            return EV_CALIBRATION_DONE;
+        }
+        uint32_t fullScale = average > 0 ? (uint32_t)((uint64_t)tempFullScale * calibrationRefC * 10 / average) : 0;
+        if (calibrationRefC <= CALIBRATION_MAX_REF_C &&
+            fullScale >= TEMP_FULL_SCALE * TEMP_GAIN_MIN_PERCENT / 100 &&
+            fullScale <= TEMP_FULL_SCALE * TEMP_GAIN_MAX_PERCENT / 100) {
+            calibrationFullScale = fullScale;
+            return EV_CALIBRATION_DONE;
+        }
+        logEvent(LOG_CALIBRATION_TEMP_FAILED, average / 10, calibrationRefC);
+        calibrationRefC = 0;
+        logEvent(LOG_CALIBRATE_TEMP);
+        playBeep(300, 500);
+        return EV_NONE;
     }
-    
-    // State changes only after consistent readings
-    bool doorCurrentlyOpen = doorOpenWarningActive ? 
-                           (doorClosedCount < DEBOUNCE_COUNT) : 
-                           (doorOpenCount >= DEBOUNCE_COUNT);
-                           
-    if (doorCurrentlyOpen != doorOpenWarningActive) {
-        doorOpenWarningActive = doorCurrentlyOpen;
-        if (doorCurrentlyOpen && systemState == IDLE) {
-            playBeep(700, 200);
+    playBeep(800, 50);
+    return EV_NONE;
+}
+
+// Start/pause held while calibrating: keep the calibration in use
+MachineEvent cancelCalibration() {
+    logEvent(LOG_CALIBRATION_CANCELLED);
+    playBeep(300, 500);
+    return checkStartInhibit();
+}
+
+// Door threshold half way between the closed and open levels, then the
+// new values are used and kept in flash
+MachineEvent finishCalibration() {
+    SensorCalibration cal = {};
+    cal.magic = CALIBRATION_MAGIC;
+    cal.doorThreshold = (uint16_t)((calibrationClosedLight + calibrationOpenLight) / 2);
+    cal.tempFullScale = calibrationFullScale;
+    cal.checksum = calibrationChecksum(cal);
+    applyCalibration(cal);
+    logEvent(LOG_CALIBRATED, cal.doorThreshold, (int)(cal.tempFullScale * 100 / TEMP_FULL_SCALE));
+    playBeep(1000, 200);
+    saveCalibration(cal);
+    return checkStartInhibit();
+}
+
+// C and the step number, with the reference entered so far on the last step
+void showCalibrationStep() {
+    uint8_t step = (uint8_t)hexDis[calibrationStep + 1];
+    if (calibrationStep == CAL_TEMPERATURE && calibrationRefC != 0) {
+        uint8_t frames[] = {
+            SEG_C, step, SEG_DASH,
+            (uint8_t)hexDis[calibrationRefC / 10 % 10], (uint8_t)hexDis[calibrationRefC % 10], SEG_BLANK
+        };
+        postDisplayFrames(frames, sizeof(frames));
+    } else {
+        uint8_t frames[] = {SEG_C, step, SEG_BLANK};
+        postDisplayFrames(frames, sizeof(frames));
+    }
+}
+
+MachineEvent refuseStartDoorOpen() {
+    logEvent(LOG_START_DOOR_OPEN);
+    playBeep(300, 500);
+    return EV_NONE;
+}
+
+MachineEvent refuseStartOverload() {
+    logEvent(LOG_START_OVERLOAD);
+    playBeep(300, 500);
+    return EV_NONE;
+}
+
+MachineEvent refuseStartSaving() {
+    logEvent(LOG_START_SAVING);
+    playBeep(300, 500);
+    return EV_NONE;
+}
+
+// Start the DWT cycle counter (Cortex-M3 and up)
+void initCycleCounter() {
+#if defined(DWT)
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+}
+
+// Current CPU cycle count (microseconds on cores without a DWT)
+uint32_t readCycleCounter() {
+#if defined(DWT)
+    return DWT->CYCCNT;
+#else
+    return us_ticker_read();
+#endif
+}
+
+// Add one duration to a section's statistics
+void recordTiming(TimingSection section, uint32_t cycles) {
+    TimingStats& t = timingStats[section];
+    if (t.count == 0 || cycles < t.min) {
+        t.min = cycles;
+    }
+    if (cycles > t.max) {
+        t.max = cycles;
+    }
+    t.count++;
+    t.total += cycles;
+    t.histogram[cycles ? 31 - __builtin_clz(cycles) : 0]++;
+}
+
+// Both run with interrupts off so the PID ISR cannot record into a half-cleared
+// or half-copied section
+void resetTimingStats() {
+    CriticalSectionLock lock;
+    memset(timingStats, 0, sizeof(timingStats));
+    lastTickStart = 0;
+}
+
+void snapshotTimingStats() {
+    CriticalSectionLock lock;
+    memcpy(timingReport, timingStats, sizeof(timingStats));
+}
+
+// Print the timing copy (telemetry thread). Always text, even in binary telemetry mode.
+void printTimingReport() {
+    printf("⏱️ Timing in cycles (%lu Hz core clock)\n", (unsigned long)SystemCoreClock);
+    for (int i = 0; i < NUM_TIMING_SECTIONS; i++) {
+        const TimingStats& t = timingReport[i];
+        unsigned long mean = t.count ? (unsigned long)(t.total / t.count) : 0;
+        printf("  %-8s n=%lu min=%lu mean=%lu max=%lu\n", TIMING_NAMES[i], (unsigned long)t.count,
+               (unsigned long)t.min, mean, (unsigned long)t.max);
+        
+        printf("          ");
+        for (int b = 0; b < TIMING_BUCKETS; b++) {
+            if (t.histogram[b]) {
+                printf(" 2^%d:%lu", b, (unsigned long)t.histogram[b]);
+            }
         }
+        printf("\n");
     }
-    
-    // Update door status LED when in IDLE state only 
-    if (systemState == IDLE) {
-        redLED = doorOpenWarningActive ? 1 : 0;
+}
+
+// Bytes used so far in a pool: stacks from the RTOS watermark, queues from
+// the arena fill left at the top of their buffer
+uint32_t poolHighWater(MemoryPool pool) {
+    if (POOL_THREADS[pool] != nullptr) {
+        return POOL_THREADS[pool]->max_stack();
     }
-    
-    // Update RGB based on load level
-    setLoadLevelColor(fsr);
-    
-    // Handle overload warning state changes
-    bool currentlyOverloaded = isOverloaded(fsr);
-    if (currentlyOverloaded != overloadWarningActive) {
-        overloadWarningActive = currentlyOverloaded;
-        if (currentlyOverloaded) {
-            printf("❗⚠️ WARNING: 🧺 Washer overloaded!\n");
-            playBeep(500, 100);
-        } else {
-            printf("✅ Load level acceptable\n");
+    const uint8_t* data = arena.pool(pool);
+    uint32_t end = POOLS[pool].size;
+    while (end >= 4) {
+        uint32_t word;
+        memcpy(&word, &data[end - 4], 4);
+        if (word != ARENA_FILL) {
+            break;
         }
+        end -= 4;
     }
+    return end;
 }
 
-// button presses
-void handleButtons() {
-    // Handle Power Button
-    if (powerButton.read() == 0 && lastPowerState == 1) {
-        if (systemState == OFF) {
-            powerOn();
+// Bytes ever allocated from the heap (0 without heap stats)
+uint32_t heapAllocatedBytes() {
+#if MBED_HEAP_STATS_ENABLED
+    mbed_stats_heap_t heap;
+    mbed_stats_heap_get(&heap);
+    return heap.total_size;
+#else
+    return 0;
+#endif
+}
+
+// End of boot: from here on the heap must stay untouched
+void lockHeap() {
+    heapLockBytes = heapAllocatedBytes();
+#if MBED_HEAP_STATS_ENABLED
+    telemetryQueue.call_every(std::chrono::milliseconds(HEAP_CHECK_PERIOD_MS), checkHeap);
+#endif
+}
+
+// Log each growth of the heap use after boot (telemetry thread)
+void checkHeap() {
+    uint32_t used = heapAllocatedBytes() - heapLockBytes;
+    if (used != heapReportedBytes) {
+        heapReportedBytes = used;
+        logEvent(LOG_HEAP_USED, (int)used);
+    }
+}
+
+// Pool sizes and high-water marks (telemetry thread)
+void printMemoryReport() {
+    printf("🧮 Static arena: %lu bytes\n", (unsigned long)ARENA_SIZE);
+    for (int i = 0; i < NUM_MEMORY_POOLS; i++) {
+        printf("  %-16s %5lu / %5lu bytes\n", POOLS[i].name,
+               (unsigned long)poolHighWater((MemoryPool)i), (unsigned long)POOLS[i].size);
+    }
+#if MBED_HEAP_STATS_ENABLED
+    printf("  %-16s %5lu bytes\n", "heap_after_boot", (unsigned long)(heapAllocatedBytes() - heapLockBytes));
+#else
+    printf("  %-16s unchecked (heap stats off)\n", "heap_after_boot");
+#endif
+}
+
+// Serial port state change (ISR), read the input on the control thread
+void serialSigio() {
+    if (serialPort.readable() && !serialInputPending.exchange(true)) {
+        controlQueue.call(handleSerialInput);
+    }
+}
+
+// Serial input from the UART RX ring buffer (filled by the RX interrupt in
+// BufferedSerial). Bytes are parsed one at a time and at most
+// SERIAL_RX_BUDGET per event, so a burst of commands is spread over several
+// control thread events instead of holding up the sensor reports.
+void handleSerialInput() {
+    serialInputPending = false;
+    
+    char c;
+    int budget = SERIAL_RX_BUDGET;
+    while (budget-- > 0 && serialPort.readable() && serialPort.read(&c, 1) == 1) {
+        if (programUploadNibbles != UPLOAD_IDLE) {
+            receiveProgramUpload(c);
+        } else if (commandParser.state != PARSE_TEXT || (uint8_t)c == TELEMETRY_SYNC) {
+            receiveCommandByte((uint8_t)c);
         } else {
-            powerOff();
+            runTextCommand(c);
         }
-        lastPowerState = 0;
     }
     
-    if (powerButton.read() == 1) {
-        lastPowerState = 1;
+    // Left over for the next event
+    if (serialPort.readable() && !serialInputPending.exchange(true)) {
+        controlQueue.call(handleSerialInput);
     }
+}
 
-    // Handle Start Button (only when system is on)
-    if (startPauseButton.read() == 0 && lastStartState == 1 && systemState != OFF) {
-        lastStartState = 0;
-        
-        // Only handle if in idle state
-        if (systemState == IDLE) {
-            // Check for door open and overload only at start
-            if (doorOpenWarningActive) {
-                printf("❌ Cannot start: Door is open! Close door first.\n");
-                playBeep(300, 500);
-            } 
-            else if (overloadWarningActive) {
-                printf("❌ Cannot start: Washer overloaded! Reduce load.\n");
-                playBeep(300, 500);
+// Binary command frames, one byte at a time. A bad length or checksum drops
+// the frame with a CMD_BAD_FRAME reply and goes back to looking for SYNC.
+void receiveCommandByte(uint8_t c) {
+    CommandParser& p = commandParser;
+    p.sum += c;
+    switch (p.state) {
+        case PARSE_TEXT:
+            p.sum = c;
+            p.state = PARSE_LENGTH;
+            break;
+            
+        case PARSE_LENGTH:
+            if (c == 0 || c > COMMAND_MAX_PAYLOAD) {
+                p.state = PARSE_TEXT;
+                logReply((CommandCode)0, CMD_BAD_FRAME);
+                break;
+            }
+            p.length = c;
+            p.received = 0;
+            p.state = PARSE_PAYLOAD;
+            break;
+            
+        case PARSE_PAYLOAD:
+            p.payload[p.received++] = c;
+            if (p.received == p.length) {
+                p.state = PARSE_CHECKSUM;
+            }
+            break;
+            
+        case PARSE_CHECKSUM:
+            p.state = PARSE_TEXT;
+            if (p.sum != 0) {
+                logReply((CommandCode)0, CMD_BAD_FRAME);
+                break;
             }
-            else {
-                // Get current settings
-                int rpm = (int)(potRPM.read() * 7.0f + 2.0f) * 100;
-                int temp = (int)(potTemp.read() * 4.0f + 2.0f) * 10;
-                int time = (static_cast<int>(roundf(potTime.read() * 8.0f)) + 1) * 10;
-                time = time > 90 ? 90 : time;
-                
-                printf("▶️ Starting wash cycle: %d RPM, %d°C, %d minutes\n", rpm, temp, time);
-                systemState = RUNNING;
-                playBeep(700, 100);
-                
-                // Run cycle
-                runCycleCountdown(time);
-                
-                // Return to idle after completion
-                systemState = IDLE;
-                printf("⏹️ Cycle ended\n");
+            CommandStatus status = runCommand(p.payload[0], &p.payload[1], p.length - 1);
+            if (status != CMD_DEFERRED) {
+                logReply((CommandCode)p.payload[0], status);
             }
-        } else if (systemState == RUNNING) {
-            printf("⚠️ Cycle already in progress\n");
-            playBeep(500, 100);
+            break;
+    }
+}
+
+// Single character commands for a terminal. 't' dumps the timing stats, 'r'
+// resets them, 'l' dumps the cycle log, 'm' the memory pools, 'p' the wash
+// programs, 's' the state and sensors. 'g' starts, 'h' pauses or continues,
+// 'x' stops the cycle, '0'-'8' select a program. 'e' toggles eco heating,
+// 'b' switches to binary frames. 'P' followed by the table in hex and a
+// newline uploads a new program table.
+void runTextCommand(char c) {
+    uint8_t arg = 0;
+    uint8_t code = 0;
+    if (c == 'P' && programWriteBusy) {
+        // programUpload holds the table being written
+        logEvent(LOG_PROGRAMS_BUSY);
+        programUploadNibbles = UPLOAD_DISCARD;
+    } else if (c == 'P') {
+        memset(&programUpload, 0, sizeof(programUpload));
+        programUploadNibbles = 0;
+    } else if (c >= '0' && c <= '9' && inState(CALIBRATING) && calibrationStep == CAL_TEMPERATURE) {
+        calibrationRefC = (calibrationRefC * 10 + (c - '0')) % 100;
+        showCalibrationStep();
+    } else if (c == 'c') {
+        code = CMD_CALIBRATE;
+        arg = (uint8_t)calibrationRefC;
+    } else if (c == 'p') {
+        telemetryQueue.call(printPrograms);
+    } else if (c == 'm') {
+        telemetryQueue.call(printMemoryReport);
+    } else if (c == 's') {
+        code = CMD_GET_SNAPSHOT;
+    } else if (c == 't') {
+        code = CMD_GET_STATS;
+    } else if (c == 'r') {
+        code = CMD_RESET_STATS;
+    } else if (c == 'l') {
+        code = CMD_GET_LOG;
+        arg = CYCLE_LOG_DUMP;
+    } else if (c == 'g') {
+        code = CMD_START;
+    } else if (c == 'h') {
+        code = inState(RUNNING) ? CMD_PAUSE : CMD_RESUME;
+    } else if (c == 'x') {
+        code = CMD_STOP;
+    } else if (c >= '0' && c <= '0' + MAX_PROGRAMS) {
+        code = CMD_SELECT;
+        arg = (uint8_t)(c - '0');
+    } else if (c == 'b') {
+        code = CMD_SET_MODE;
+        arg = 1;
+    } else if (c == 'e') {
+        code = CMD_SET_ECO;
+        arg = !ecoHeating;
+    }
+    
+    bool takesArg = code == CMD_SELECT || code == CMD_SET_MODE || code == CMD_GET_LOG || code == CMD_SET_ECO ||
+                    (code == CMD_CALIBRATE && inState(CALIBRATING) && calibrationStep == CAL_TEMPERATURE);
+    if (code != 0) {
+        CommandStatus status = runCommand(code, &arg, takesArg ? 1 : 0);
+        if (status == CMD_REFUSED || status == CMD_BAD_ARGS) {
+            logEvent(LOG_COMMAND_REFUSED);
         }
     }
+}
+
+// Run one command (control thread). Cycle control goes through the same
+// state machine events as the buttons, only from the states a button would
+// do that in.
+CommandStatus runCommand(uint8_t code, const uint8_t* args, int argCount) {
+    switch (code) {
+        case CMD_PING:
+            return CMD_OK;
+            
+        case CMD_GET_SNAPSHOT:
+            logSettings(lastReading.rpm, lastReading.temp, lastReading.time);
+            logSensors(lastReading.load, lastReading.tempActual, lastReading.light, lastReading.doorOpen);
+            logStatus();
+            return CMD_OK;
+            
+        case CMD_SELECT:
+            if (!inState(IDLE) || inState(SAVING_SETTINGS)) {
+                return CMD_REFUSED;
+            }
+            if (argCount < 1 || args[0] > programCount()) {
+                return CMD_BAD_ARGS;
+            }
+            selectProgram(args[0]);
+            return CMD_OK;
+            
+        case CMD_START:
+            if (!inState(IDLE)) {
+                return CMD_REFUSED;
+            }
+            if (argCount >= 1) {
+                if (args[0] > programCount()) {
+                    return CMD_BAD_ARGS;
+                }
+                // A start would resume the offered cycle, not run this program
+                if (resumeAvailable) {
+                    return CMD_REFUSED;
+                }
+                // The door, load and settings substates refuse the start
+                // themselves, the selection stays as it was
+                if (systemState == IDLE) {
+                    selectProgram(args[0]);
+                }
+            }
+            dispatchEvent(EV_START);
+            return inState(RUNNING) ? CMD_OK : CMD_REFUSED;
+            
+        case CMD_PAUSE:
+            if (!inState(RUNNING)) {
+                return CMD_REFUSED;
+            }
+            dispatchEvent(EV_START);
+            return CMD_OK;
+            
+        case CMD_RESUME:
+            if (!inState(PAUSED)) {
+                return CMD_REFUSED;
+            }
+            dispatchEvent(EV_START);
+            return inState(RUNNING) ? CMD_OK : CMD_REFUSED;
+            
+        case CMD_STOP:
+            if (!inState(RUNNING) && !inState(PAUSED) && !inState(CALIBRATING)) {
+                return CMD_REFUSED;
+            }
+            dispatchEvent(EV_LONG_PRESS);
+            return CMD_OK;
+            
+        case CMD_GET_STATS:
+            snapshotTimingStats();
+            if (telemetryBinary) {
+                telemetryQueue.call(sendTimingReport);
+                return CMD_DEFERRED;
+            }
+            telemetryQueue.call(printTimingReport);
+            return CMD_OK;
+            
+        case CMD_RESET_STATS:
+            resetTimingStats();
+            return CMD_OK;
+            
+        case CMD_GET_LOG:
+            if (telemetryBinary) {
+                telemetryQueue.call(sendCycleLog, argCount >= 1 ? (int)args[0] : CYCLE_LOG_DUMP);
+                return CMD_DEFERRED;
+            }
+            telemetryQueue.call(printCycleLog);
+            return CMD_OK;
+            
+        case CMD_SET_MODE:
+            if (argCount < 1 || args[0] > 1) {
+                return CMD_BAD_ARGS;
+            }
+            setTelemetryMode(args[0] == 1);
+            return CMD_OK;
+            
+        case CMD_SET_ECO:
+            if (argCount < 1 || args[0] > 1) {
+                return CMD_BAD_ARGS;
+            }
+            ecoHeating = args[0] == 1;
+            logEvent(ecoHeating ? LOG_ECO_ON : LOG_ECO_OFF);
+            return CMD_OK;
+            
+        case CMD_CALIBRATE:
+            if (inState(IDLE)) {
+                dispatchEvent(EV_CALIBRATE);
+                return inState(CALIBRATING) ? CMD_OK : CMD_REFUSED;
+            }
+            if (!inState(CALIBRATING)) {
+                return CMD_REFUSED;
+            }
+            if (argCount >= 1) {
+                if (calibrationStep != CAL_TEMPERATURE || args[0] > CALIBRATION_MAX_REF_C) {
+                    return CMD_BAD_ARGS;
+                }
+                calibrationRefC = args[0];
+            }
+            dispatchEvent(EV_START);
+            return CMD_OK;
+            
+        default:
+            return CMD_UNKNOWN;
+    }
+}
+
+// Timing sections as binary frames, then the reply (telemetry thread)
+void sendTimingReport() {
+    for (int i = 0; i < NUM_TIMING_SECTIONS; i++) {
+        const TimingStats& t = timingReport[i];
+        TimingFrame frame = {TLM_TIMING, (uint8_t)i, 0, t.count, t.min, t.max,
+                             t.count ? (uint32_t)(t.total / t.count) : 0};
+        sendFrame(&frame, sizeof(frame));
+    }
+    logReply(CMD_GET_STATS, CMD_OK, NUM_TIMING_SECTIONS);
+}
+
+// Newest cycle log records as binary frames, then the reply (telemetry thread)
+void sendCycleLog(int count) {
+    int sent = 0;
+    if (cycleLogEnd != 0) {
+        forEachCycleRecord([&](const CycleRecord& record) {
+            if (sent >= count) {
+                return false;
+            }
+            LogRecordFrame frame = {TLM_LOG_RECORD, {0, 0, 0}, record};
+            sendFrame(&frame, sizeof(frame));
+            sent++;
+            return true;
+        });
+    }
+    logReply(CMD_GET_LOG, cycleLogEnd != 0 ? CMD_OK : CMD_REFUSED, sent);
+}
+
+#if defined(WASHER_BENCHMARK)
+const int BENCH_ITERATIONS = 1000;        // Calls per benchmark
+const int BENCH_INPUTS = 64;              // Distinct inputs cycled through (power of 2)
+
+uint16_t benchRaw[BENCH_INPUTS];          // Spread of raw ADC values
+volatile int benchSink;                   // Keeps results from being optimised away
+uint32_t benchOverhead = 0;               // Cost of an empty benchmark loop
+
+// Time BENCH_ITERATIONS calls of body(i) and print one CSV row.
+// Cycles per call has the empty loop cost removed.
+template<typename F>
+void runBenchmark(const char* name, F body) {
+    uint32_t start = readCycleCounter();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        body(i);
+    }
+    uint32_t total = readCycleCounter() - start;
+    uint32_t net = total > benchOverhead ? total - benchOverhead : 0;
+    
+    uint32_t hundredths = (uint32_t)((uint64_t)net * 100 / BENCH_ITERATIONS);
+    printf("%s,%d,%lu,%lu.%02lu\n", name, BENCH_ITERATIONS, (unsigned long)net,
+           (unsigned long)(hundredths / 100), (unsigned long)(hundredths % 100));
+}
+
+// Per-tick hot paths, float against fixed-point where both exist.
+// Printed as CSV: name,calls,total_cycles,cycles_per_call
+void runBenchmarks() {
+    for (int i = 0; i < BENCH_INPUTS; i++) {
+        benchRaw[i] = (uint16_t)((i * 40503u) & 0xFFFF);
+    }
     
-    if (startPauseButton.read() == 1) {
-        lastStartState = 1;
+    printf("# core_hz,%lu\n", (unsigned long)SystemCoreClock);
+    printf("name,calls,total_cycles,cycles_per_call\n");
+    
+    uint32_t start = readCycleCounter();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        benchSink = benchRaw[i % BENCH_INPUTS];
     }
+    benchOverhead = readCycleCounter() - start;
+    
+    // Sensor mapping: lookup tables against the float formulas they replaced
+    runBenchmark("map_rpm_lut", [](int i) { benchSink = potToRpm(benchRaw[i % BENCH_INPUTS]); });
+    runBenchmark("map_rpm_float", [](int i) { benchSink = rpmFromPot(benchRaw[i % BENCH_INPUTS] / 65535.0f); });
+    runBenchmark("map_temp_lut", [](int i) { benchSink = potToTemp(benchRaw[i % BENCH_INPUTS]); });
+    runBenchmark("map_temp_float", [](int i) { benchSink = tempFromPot(benchRaw[i % BENCH_INPUTS] / 65535.0f); });
+    runBenchmark("map_time_lut", [](int i) { benchSink = potToTime(benchRaw[i % BENCH_INPUTS]); });
+    runBenchmark("map_time_float", [](int i) { benchSink = timeFromPot(benchRaw[i % BENCH_INPUTS] / 65535.0f); });
+    runBenchmark("scale_fixed", [](int i) { benchSink = scaleRaw(benchRaw[i % BENCH_INPUTS], LOAD_FULL_SCALE); });
+    runBenchmark("scale_float", [](int i) { benchSink = (int)(benchRaw[i % BENCH_INPUTS] / 65535.0f * 1000.0f); });
+    
+    runBenchmark("significant_change", [](int i) {
+        benchSink = hasSignificantChange(benchRaw[i % BENCH_INPUTS], benchRaw[(i + 1) % BENCH_INPUTS], FSR_THRESHOLD);
+    });
+    
+    // Door debounce with a reading that flips every 4 samples, so state changes are included
+    runBenchmark("door_debounce", [](int i) { doorOpenWarningActive = debounceDoor((i & 4) != 0); });
+    doorOpenWarningActive = false;
+    doorOpenCount = 0;
+    doorClosedCount = 0;
+    
+    runBenchmark("load_color", [](int i) { setLoadLevelColor(benchRaw[i % BENCH_INPUTS] % 1000); });
+    
+    // ADC paths: sampled polling scan (no DMA path on this board) and one filtered read
+    runBenchmark("adc_scan_poll", [](int) { scanAdcChannels(); });
+    runBenchmark("adc_read_filtered", [](int i) { benchSink = readAdcRaw((AdcChannel)(i % NUM_ADC_CHANNELS)); });
+    
+    // One PID step with a moving measurement
+    PidController benchPid = motorPid;
+    runBenchmark("pid_update", [&](int i) { benchSink = pidUpdate(benchPid, 500, benchRaw[i % BENCH_INPUTS] >> 6); });
+    
+    // Imbalance detector, one 1 kHz FSR sample through the Goertzel bin
+    Goertzel benchGoertzel;
+    goertzelInit(benchGoertzel, 1000);
+    runBenchmark("goertzel_step", [&](int i) { goertzelStep(benchGoertzel, (benchRaw[i % BENCH_INPUTS] >> 4) - 2048); });
+    benchSink = (int)goertzelPower(benchGoertzel);
+    
+    // Power-loss checkpoint, written every tick while a cycle runs
+    runBenchmark("checkpoint_write", [](int) { writeCheckpoint(); });
+    clearCheckpoint();
+    
+    // Snapshot handoff between the safety thread and its readers
+    SensorSnapshot benchSnapshot = {};
+    runBenchmark("snapshot_publish", [&](int i) { benchSnapshot.load = (int16_t)i; publishSnapshot(benchSnapshot); });
+    runBenchmark("snapshot_read", [&](int) { readSnapshot(benchSnapshot); benchSink = benchSnapshot.load; });
+    
+    // Full sensor pass in IDLE with whatever the inputs currently read
+    systemState = IDLE;
+    runBenchmark("sensors_full", [](int) { readAndProcessSensors(); });
+    
+    // State machine lookup alone, with an event IDLE ignores
+    runBenchmark("state_dispatch", [](int) { dispatchEvent(EV_DOOR_CLOSED); });
+    systemState = OFF;
+    
+    // Remaining time estimate, run every tick: early in a 60°C cycle, still to heat
+    loadHeatHistory();
+    planManualCycle(60, 800, 60, 300);
+    cyclePhase = PHASE_FILL;
+    runBenchmark("estimate_remaining", [](int i) { benchSink = estimateRemainingMs(i); });
+}
+#endif
+
+// Route printf through the buffered serial port
+FileHandle* mbed::mbed_override_console(int) {
+    return &serialPort;
 }
 
 int main() {
     // Initialize components
     buzzer.write(0.0f);
+    heater.write(0.0f);
+    motor.write(0.0f);
     setRGB(0.0f, 0.0f, 0.0f);
     redLED = 0;
-    updateDisplay(0);
+    segDis = SEG_BLANK;
     
-    printf("🔄 System starting in OFF state\n");
+    // Cycle counter for the section timing, stats start empty
+    initCycleCounter();
+    resetTimingStats();
     
-    while (true) {
-        // Handle buttons even in off mode
-        handleButtons();
-        
-        switch (systemState) {
-            case OFF:
-                // Wait for power button in OFF state
-                wait_us(500000);
-                break;
-                
-            case IDLE:
-            case RUNNING:
-                // Process sensors and update displays
-                readAndProcessSensors();
-                wait_us(100000);  // 100ms
-                break;
-        }
-    }
-}
\ No newline at end of file
+#if defined(WASHER_BENCHMARK)
+    // Benchmark builds run the suite instead of the washer
+    runBenchmarks();
+    return 0;
+#endif
+    
+    // Find the cycle log head before anything can append to it
+    initCycleLog();
+    
+    // Uploaded wash programs, in the sector below the cycle log
+    initProgramTable();
+    
+    // Door threshold and temperature gain from the last calibration
+    initCalibration();
+    
+    // Heating rates of past cycles for the remaining time estimate
+    loadHeatHistory();
+    
+    // Checkpoint left by a power loss mid-cycle
+    initCheckpoint();
+    
+    // Telemetry mode chosen before a reset, so boot reports go out in it
+    initTelemetryMode();
+    
+    // Fault recorded before a watchdog reset
+    reportFaultRecord();
+    
+    // Serial commands are read when the RX interrupt reports data
+    serialPort.sigio(&serialSigio);
+    
+    // Safety, UI and telemetry threads each dispatch their own queue
+    safetyThread.start(callback(&safetyQueue, &EventQueue::dispatch_forever));
+    uiThread.start(callback(&uiQueue, &EventQueue::dispatch_forever));
+    telemetryThread.start(callback(&telemetryQueue, &EventQueue::dispatch_forever));
+    logEvent(LOG_BOOT);
+    
+    // Everything is allocated, the heap guard starts counting
+    lockHeap();
+    
+    // Buttons are sampled by the 1 ms ticker, in standby a power button edge restarts it
+    powerButton.fall(&powerButtonWake);
+    startButtonSampling();
+    
+    // Supervised from here on, a hang resets the machine
+    startWatchdog();
+    
+    // Start in standby, periodic events begin on power on
+    uiQueue.call(enterStandby);
+    
+    // This thread runs the control queue, sleeping between events
+    controlQueue.dispatch_forever();
+}
@@ -0,0 +1,485 @@
+// Host simulation of the subset of the Mbed OS API used by main.cpp.
+// Time is virtual: wait_us(), Ticker, Timeout and EventQueue all run
+// against one simulated clock, so long cycles finish in milliseconds.
+#ifndef WASHER_SIM_MBED_H
+#define WASHER_SIM_MBED_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <sys/types.h>
+#include <functional>
+#include <utility>
+
+using namespace std::chrono_literals;
+
+// Pins used by the firmware
+enum PinName {
+    PA_1, PA_5, PA_6, PA_7, PA_8, PA_11, PA_12, PA_15,
+    PB_1, PB_3, PB_4, PB_5, PB_6, PB_7, PB_11, PB_12, PB_14, PB_15,
+    PC_0, PC_2, PC_3, PC_10, PC_11,
+    USBTX, USBRX,
+    NUM_SIM_PINS,
+    NC = -1
+};
+
+enum PinMode {
+    PullNone,
+    PullUp,
+    PullDown,
+    PullDefault = PullNone
+};
+
+// Virtual clock and pin state shared with sim_hal.cpp
+namespace sim {
+uint64_t now_us();
+void advance_us(uint64_t us);
+float analog_value(PinName pin);
+int digital_value(PinName pin);
+void output_changed(PinName pin, const char* kind, float value);
+void add_timer(void* owner, uint64_t due_us, std::function<void()> fn);
+void remove_timers(void* owner);
+[[noreturn]] void run_forever();
+uint32_t app_rom_end();
+}
+
+namespace mbed {
+
+template <typename F>
+class Callback;
+
+template <typename R, typename... A>
+class Callback<R(A...)> {
+public:
+    Callback() {}
+    Callback(std::nullptr_t) {}
+    Callback(R (*fn)(A...)) : _fn(fn) {}
+    template <typename T>
+    Callback(T* obj, R (T::*method)(A...)) : _fn([obj, method](A... a) { return (obj->*method)(a...); }) {}
+    template <typename F, typename = decltype(std::declval<F>()(std::declval<A>()...))>
+    Callback(F f) : _fn(f) {}
+
+    R operator()(A... a) const { return _fn(a...); }
+    explicit operator bool() const { return static_cast<bool>(_fn); }
+
+private:
+    std::function<R(A...)> _fn;
+};
+
+template <typename R, typename... A>
+Callback<R(A...)> callback(R (*fn)(A...)) { return Callback<R(A...)>(fn); }
+
+template <typename T, typename R, typename... A>
+Callback<R(A...)> callback(T* obj, R (T::*method)(A...)) { return Callback<R(A...)>(obj, method); }
+
+class FileHandle {
+public:
+    virtual ~FileHandle() {}
+};
+
+FileHandle* mbed_override_console(int fd);
+
+// Writes go to stdout, reads come from SERIAL lines in the trace
+class BufferedSerial : public FileHandle {
+public:
+    BufferedSerial(PinName tx, PinName rx, int baud = 9600);
+    ~BufferedSerial();
+    ssize_t write(const void* buffer, size_t size) {
+        fwrite(buffer, 1, size, stdout);
+        return static_cast<ssize_t>(size);
+    }
+    ssize_t read(void* buffer, size_t size);
+    bool readable() const;
+    void sigio(Callback<void()> cb) { _sigio = cb; }
+    int set_blocking(bool blocking) { (void)blocking; return 0; }
+    void set_baud(int baud) { (void)baud; }
+    void notify() { if (_sigio) _sigio(); }
+
+private:
+    Callback<void()> _sigio;
+};
+
+class AnalogIn {
+public:
+    AnalogIn(PinName pin, float vref = 3.3f) : _pin(pin) { (void)vref; }
+    float read() { return sim::analog_value(_pin); }
+    uint16_t read_u16() { return static_cast<uint16_t>(sim::analog_value(_pin) * 65535.0f + 0.5f); }
+    operator float() { return read(); }
+
+private:
+    PinName _pin;
+};
+
+class DigitalIn {
+public:
+    DigitalIn(PinName pin) : _pin(pin) {}
+    DigitalIn(PinName pin, PinMode) : _pin(pin) {}
+    int read() { return sim::digital_value(_pin); }
+    void mode(PinMode) {}
+    operator int() { return read(); }
+
+protected:
+    PinName _pin;
+};
+
+class InterruptIn : public DigitalIn {
+public:
+    InterruptIn(PinName pin);
+    InterruptIn(PinName pin, PinMode) : InterruptIn(pin) {}
+    ~InterruptIn();
+    int read() { return DigitalIn::read(); }
+    operator int() { return read(); }
+    void fall(Callback<void()> cb) { _fall = cb; }
+    void rise(Callback<void()> cb) { _rise = cb; }
+    void enable_irq() { _enabled = true; }
+    void disable_irq() { _enabled = false; }
+    void edge(int level);
+
+private:
+    Callback<void()> _fall;
+    Callback<void()> _rise;
+    bool _enabled = true;
+};
+
+class DigitalOut {
+public:
+    DigitalOut(PinName pin, int value = 0) : _pin(pin), _value(value) {}
+    void write(int value) {
+        if (value != _value) {
+            _value = value;
+            sim::output_changed(_pin, "digital", value);
+        }
+    }
+    int read() { return _value; }
+    DigitalOut& operator=(int value) { write(value); return *this; }
+    operator int() { return _value; }
+
+private:
+    PinName _pin;
+    int _value;
+};
+
+class BusOut {
+public:
+    template <typename... P>
+    BusOut(PinName first, P...) : _first(first) {}
+    void write(int value) {
+        if (value != _value) {
+            _value = value;
+            sim::output_changed(_first, "bus", value);
+        }
+    }
+    int read() { return _value; }
+    BusOut& operator=(int value) { write(value); return *this; }
+    operator int() { return _value; }
+
+private:
+    PinName _first;
+    int _value = 0;
+};
+
+class PwmOut {
+public:
+    PwmOut(PinName pin) : _pin(pin) {}
+    void period(float seconds) { _period = seconds; }
+    void period_ms(int ms) { _period = ms / 1000.0f; }
+    void period_us(int us) { _period = us / 1000000.0f; }
+    void write(float value) {
+        if (value != _duty) {
+            _duty = value;
+            sim::output_changed(_pin, "pwm", value);
+        }
+    }
+    float read() { return _duty; }
+    void suspend() { _suspended = true; }
+    void resume() { _suspended = false; }
+    PwmOut& operator=(float value) { write(value); return *this; }
+    operator float() { return _duty; }
+
+private:
+    PinName _pin;
+    float _period = 0.02f;
+    float _duty = 0.0f;
+    bool _suspended = false;
+};
+
+class Ticker {
+public:
+    ~Ticker() { detach(); }
+    template <typename Rep, typename Period>
+    void attach(Callback<void()> cb, std::chrono::duration<Rep, Period> interval) {
+        detach();
+        _cb = cb;
+        _interval_us = std::chrono::duration_cast<std::chrono::microseconds>(interval).count();
+        schedule();
+    }
+    void detach() { sim::remove_timers(this); }
+
+protected:
+    virtual void fire() { schedule(); _cb(); }
+    void schedule() { sim::add_timer(this, sim::now_us() + _interval_us, [this]() { fire(); }); }
+    Callback<void()> _cb;
+    uint64_t _interval_us = 0;
+};
+
+class Timeout : public Ticker {
+protected:
+    void fire() override { _cb(); }
+};
+
+typedef Ticker LowPowerTicker;
+typedef Timeout LowPowerTimeout;
+
+class Timer {
+public:
+    void start() { if (!_running) { _running = true; _start = sim::now_us(); } }
+    void stop() { if (_running) { _acc += sim::now_us() - _start; _running = false; } }
+    void reset() { _acc = 0; _start = sim::now_us(); }
+    std::chrono::microseconds elapsed_time() const {
+        return std::chrono::microseconds(_acc + (_running ? sim::now_us() - _start : 0));
+    }
+    int read_us() const { return static_cast<int>(elapsed_time().count()); }
+
+private:
+    bool _running = false;
+    uint64_t _start = 0;
+    uint64_t _acc = 0;
+};
+
+typedef Timer LowPowerTimer;
+
+// Internal flash with STM32F4 sector sizes, erased to 0xFF and programmed
+// by clearing bits. WASHER_SIM_FLASH names a file that keeps the image
+// across runs.
+class FlashIAP {
+public:
+    int init();
+    int deinit() { return 0; }
+    int read(void* buffer, uint32_t addr, uint32_t size);
+    int program(const void* buffer, uint32_t addr, uint32_t size);
+    int erase(uint32_t addr, uint32_t size);
+    uint32_t get_page_size() const { return 4; }
+    uint32_t get_sector_size(uint32_t addr) const;
+    uint32_t get_flash_start() const { return 0x08000000; }
+    uint32_t get_flash_size() const { return 512 * 1024; }
+    uint8_t get_erase_value() const { return 0xFF; }
+};
+
+// End of the application image in flash (FlashIAP.h takes it from the
+// linker). WASHER_SIM_IMAGE_KB sets the image size, 100 KB by default.
+#define FLASHIAP_APP_ROM_END_ADDR (sim::app_rom_end())
+
+// Independent watchdog: a missed kick resets the simulation like a power
+// loss, and the next run reports RESET_REASON_WATCHDOG
+class Watchdog {
+public:
+    static Watchdog& get_instance();
+    bool start(uint32_t timeout_ms);
+    bool stop() { return false; }   // The IWDG cannot be stopped once started
+    void kick();
+    uint32_t get_timeout() const { return _timeout_ms; }
+    uint32_t get_max_timeout() const { return 32768; }
+    bool is_running() const { return _running; }
+
+private:
+    Watchdog() {}
+    uint32_t _timeout_ms = 0;
+    bool _running = false;
+};
+
+enum reset_reason_t {
+    RESET_REASON_POWER_ON,
+    RESET_REASON_PIN_RESET,
+    RESET_REASON_BROWN_OUT,
+    RESET_REASON_SOFTWARE,
+    RESET_REASON_WATCHDOG,
+    RESET_REASON_LOCKUP,
+    RESET_REASON_WAKE_LOW_POWER,
+    RESET_REASON_ACCESS_ERROR,
+    RESET_REASON_BOOT_ERROR,
+    RESET_REASON_MULTIPLE,
+    RESET_REASON_PLATFORM,
+    RESET_REASON_UNKNOWN
+};
+
+// Why the previous run ended, kept in the WASHER_SIM_BACKUP file
+class ResetReason {
+public:
+    static reset_reason_t get();
+};
+
+class CriticalSectionLock {
+public:
+    CriticalSectionLock() {}
+    ~CriticalSectionLock() {}
+};
+
+} // namespace mbed
+
+extern uint32_t SystemCoreClock;
+
+// RTC backup registers, kept across runs in the WASHER_SIM_BACKUP file
+// (written when the simulation ends, which stands in for a power loss)
+struct SimRtc {
+    volatile uint32_t BKP0R;
+    volatile uint32_t BKPR[19];   // BKP1R-BKP19R
+};
+extern SimRtc simRtc;
+#define RTC (&simRtc)
+#define __HAL_RCC_PWR_CLK_ENABLE() do {} while (0)
+inline void HAL_PWR_EnableBkUpAccess() {}
+
+#if defined(WASHER_BENCHMARK)
+// Benchmark builds time code with the host clock: CYCCNT counts host
+// nanoseconds and SystemCoreClock reports 1 GHz to match
+struct SimCycleCounter {
+    uint32_t offset = 0;
+    static uint32_t host_ns() {
+        return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+    operator uint32_t() const { return host_ns() - offset; }
+    SimCycleCounter& operator=(uint32_t value) { offset = host_ns() - value; return *this; }
+};
+
+struct SimDwt {
+    uint32_t CTRL;
+    SimCycleCounter CYCCNT;
+};
+
+struct SimCoreDebug {
+    uint32_t DEMCR;
+};
+
+extern SimDwt simDwt;
+extern SimCoreDebug simCoreDebug;
+#define DWT (&simDwt)
+#define CoreDebug (&simCoreDebug)
+#define DWT_CTRL_CYCCNTENA_Msk (1u << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk (1u << 24)
+#endif
+inline uint32_t us_ticker_read() { return static_cast<uint32_t>(sim::now_us()); }
+
+// Heap statistics, enabled as in mbed_app.json. The firmware allocates
+// nothing after boot and the host's own allocations are not counted, so
+// the heap guard runs and always reads an untouched heap.
+#define MBED_HEAP_STATS_ENABLED 1
+
+struct mbed_stats_heap_t {
+    uint32_t current_size;
+    uint32_t max_size;
+    uint32_t total_size;
+    uint32_t reserved_size;
+    uint32_t alloc_cnt;
+    uint32_t alloc_fail_cnt;
+    uint32_t overhead_size;
+};
+
+inline void mbed_stats_heap_get(mbed_stats_heap_t* stats) { memset(stats, 0, sizeof(*stats)); }
+
+inline void core_util_critical_section_enter() {}
+inline void core_util_critical_section_exit() {}
+
+typedef enum {
+    osPriorityIdle = 1,
+    osPriorityLow = 8,
+    osPriorityBelowNormal = 16,
+    osPriorityNormal = 24,
+    osPriorityAboveNormal = 32,
+    osPriorityHigh = 40,
+    osPriorityRealtime = 48
+} osPriority;
+
+typedef int osStatus;
+#define osOK 0
+#define OS_STACK_SIZE 4096
+
+namespace rtos {
+
+// Threads are cooperative in the simulation: start() does not run the task,
+// so every thread must only dispatch an EventQueue (the scheduler runs all
+// queues from the main thread).
+class Thread {
+public:
+    Thread(osPriority priority = osPriorityNormal, uint32_t stack_size = OS_STACK_SIZE,
+           unsigned char* stack_mem = nullptr, const char* name = nullptr)
+        : _stack_size(stack_size) { (void)priority; (void)stack_mem; (void)name; }
+    osStatus start(mbed::Callback<void()> task) { (void)task; return osOK; }
+    uint32_t stack_size() const { return _stack_size; }
+    uint32_t max_stack() const { return 0; }
+    uint32_t flags_set(uint32_t flags) { return flags; }
+
+private:
+    uint32_t _stack_size;
+};
+
+struct Kernel {
+    struct Clock {
+        typedef std::chrono::milliseconds duration;
+        typedef std::chrono::time_point<Clock, duration> time_point;
+        static time_point now() { return time_point(duration(sim::now_us() / 1000)); }
+    };
+};
+
+namespace ThisThread {
+template <typename Rep, typename Period>
+void sleep_for(std::chrono::duration<Rep, Period> d) {
+    sim::advance_us(std::chrono::duration_cast<std::chrono::microseconds>(d).count());
+}
+}
+
+} // namespace rtos
+
+namespace events {
+
+#define EVENTS_EVENT_SIZE (64)
+#define EVENTS_QUEUE_SIZE (32 * EVENTS_EVENT_SIZE)
+
+// Every EventQueue is dispatched by the simulated scheduler, so threads
+// that only dispatch a queue need no host thread of their own.
+class EventQueue {
+public:
+    // A caller's buffer is written one EVENTS_EVENT_SIZE block per pending
+    // event from the bottom, like the slab of the real queue
+    EventQueue(unsigned size = EVENTS_QUEUE_SIZE, unsigned char* buffer = nullptr) : _size(size), _buffer(buffer) {}
+    ~EventQueue() { sim::remove_timers(this); }
+
+    template <typename F, typename... A>
+    int call(F f, A... a) { return post(0, 0, [=]() { f(a...); }); }
+
+    template <typename Rep, typename Period, typename F, typename... A>
+    int call_in(std::chrono::duration<Rep, Period> d, F f, A... a) {
+        return post(to_us(d), 0, [=]() { f(a...); });
+    }
+
+    template <typename Rep, typename Period, typename F, typename... A>
+    int call_every(std::chrono::duration<Rep, Period> d, F f, A... a) {
+        return post(to_us(d), to_us(d), [=]() { f(a...); });
+    }
+
+    bool cancel(int id);
+    void dispatch_forever() { sim::run_forever(); }
+
+private:
+    template <typename Rep, typename Period>
+    static uint64_t to_us(std::chrono::duration<Rep, Period> d) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+    }
+    int post(uint64_t delay_us, uint64_t period_us, std::function<void()> fn);
+    unsigned _size;
+    unsigned char* _buffer;
+};
+
+} // namespace events
+
+using namespace mbed;
+using namespace rtos;
+using namespace events;
+
+inline void wait_us(int us) { sim::advance_us(us); }
+
+#endif
@@ -0,0 +1,76 @@
+#!/bin/sh
+# Trace regression: builds the simulator, runs every trace in sim/traces
+# from a fresh flash and backup register file, and compares the output with
+# the trace's golden NAME.out. With --update the goldens are rewritten
+# instead (review their diff before committing it). Binary traces are fed
+# through the collector, and its record counts are compared instead.
+#
+#     sim/run_traces.sh [--update] [TRACE.csv...]
+set -u
+cd "$(dirname "$0")/.." || exit 1
+
+update=0
+if [ "${1:-}" = "--update" ]; then
+    update=1
+    shift
+fi
+[ $# -gt 0 ] || set -- sim/traces/*.csv
+
+# Only the trace decides how a run goes
+unset WASHER_SIM_END_MS WASHER_SIM_VERBOSE WASHER_SIM_IMAGE_KB
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+CXX=${CXX:-g++}
+CXXFLAGS="-std=gnu++14 -O2 -Wall -Wextra -Isim"
+$CXX $CXXFLAGS main.cpp sim/sim_hal.cpp -o "$tmp/washer_sim" || exit 1
+# full_cycle.csv is timed for the real-time scale
+$CXX $CXXFLAGS -DWASHER_MS_PER_MINUTE=60000 main.cpp sim/sim_hal.cpp -o "$tmp/washer_sim_rt" || exit 1
+$CXX -std=gnu++14 -O2 -Wall -Wextra collector/collector.cpp -o "$tmp/collector" || exit 1
+
+failed=0
+for trace in "$@"; do
+    name=$(basename "$trace" .csv)
+    golden=$(dirname "$trace")/$name.out
+    sim=$tmp/washer_sim
+    runs=1
+    collect=0
+    case $name in
+        full_cycle) sim=$tmp/washer_sim_rt ;;
+        # The second run boots from the flash and backup registers of the first
+        calibration|watchdog) runs=2 ;;
+        collector_reset) runs=2; collect=1 ;;
+    esac
+
+    rm -f "$tmp/flash" "$tmp/backup"
+    : > "$tmp/out"
+    run=1
+    while [ $run -le $runs ]; do
+        [ $run -eq 1 ] || [ $collect -eq 1 ] || echo "--- run $run" >> "$tmp/out"
+        WASHER_SIM_TRACE=$trace WASHER_SIM_FLASH=$tmp/flash WASHER_SIM_BACKUP=$tmp/backup \
+            "$sim" >> "$tmp/out" 2>&1
+        run=$((run + 1))
+    done
+    if [ $collect -eq 1 ]; then
+        # Both runs as one serial stream, as the collector would read it.
+        # Sample times come from the host clock, so only counts are kept.
+        mv "$tmp/out" "$tmp/serial"
+        rm -f "$tmp/store"
+        "$tmp/collector" record "$tmp/store" "$name=$tmp/serial" 2> /dev/null
+        { "$tmp/collector" list "$tmp/store" | cut -d, -f1-4
+          "$tmp/collector" aborts "$tmp/store"; } > "$tmp/out"
+    fi
+
+    if [ $update -eq 1 ]; then
+        cp "$tmp/out" "$golden"
+        echo "updated $golden"
+    elif diff -u "$golden" "$tmp/out" > "$tmp/diff" 2>&1; then
+        echo "ok      $name"
+    else
+        echo "FAILED  $name"
+        cat "$tmp/diff"
+        failed=1
+    fi
+done
+exit $failed
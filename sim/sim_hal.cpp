@@ -0,0 +1,514 @@
+// Virtual clock, scheduler and trace player for the host simulation.
+//
+// Trace format (WASHER_SIM_TRACE), one change per line:
+//     <time_ms>,<signal>,<value>
+// where <signal> is a pin name (PA_1, PC_10, ...), SERIAL, WOBBLE, HANG or
+// END. Analog pins take 0.0-1.0, buttons take 0 (pressed) or 1 (released).
+// SERIAL sends the rest of the line (plus a newline) to the serial port.
+// WOBBLE sets the amplitude of an unbalanced drum on the FSR (PA_1): a
+// sine at the drum speed, taken from the motor duty. HANG stops every
+// thread for <value> ms while interrupts keep running. Lines starting with
+// '#' are comments.
+#include "mbed.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <map>
+#include <sys/mman.h>
+#include <string>
+#include <vector>
+
+SimRtc simRtc;
+
+#if defined(WASHER_BENCHMARK)
+uint32_t SystemCoreClock = 1000000000;
+SimDwt simDwt;
+SimCoreDebug simCoreDebug;
+#else
+uint32_t SystemCoreClock = 84000000;
+#endif
+
+void injectSerial(const std::string& text);
+
+namespace {
+
+struct Scheduled {
+    void* owner;
+    int id;
+    uint64_t period_us;
+    std::function<void()> fn;
+};
+
+// Ordered by (due time, insertion order) so equal deadlines run FIFO
+typedef std::map<std::pair<uint64_t, uint64_t>, Scheduled> Schedule;
+
+uint64_t nowUs = 0;
+uint64_t insertSeq = 0;
+uint64_t endUs = 10000000;
+uint64_t hangUntilUs = 0;   // Threads stopped until then (HANG)
+int nextEventId = 1;
+bool verbose = false;
+// Built on first use and never destroyed, so firmware globals can touch
+// it from their constructors and destructors in any order
+struct SimState {
+    Schedule timers;   // ISR context: Ticker, Timeout, trace changes
+    Schedule events;   // Thread context: EventQueue
+    std::multimap<int, InterruptIn*> interruptPins;
+};
+
+SimState& state() {
+    static SimState* s = new SimState;
+    return *s;
+}
+
+float analogPins[NUM_SIM_PINS];
+int digitalPins[NUM_SIM_PINS];
+float outputValues[NUM_SIM_PINS];
+
+// Unbalanced drum: the firmware's motor model, duty × 1200 RPM (MOTOR_MAX_RPM)
+const double SIM_MOTOR_MAX_RPM = 1200.0;
+float wobbleAmplitude = 0.0f;
+double drumAngle = 0.0;        // Radians, integrated as the FSR is read
+uint64_t drumAngleUs = 0;
+
+const char* const pinNames[NUM_SIM_PINS] = {
+    "PA_1", "PA_5", "PA_6", "PA_7", "PA_8", "PA_11", "PA_12", "PA_15",
+    "PB_1", "PB_3", "PB_4", "PB_5", "PB_6", "PB_7", "PB_11", "PB_12", "PB_14", "PB_15",
+    "PC_0", "PC_2", "PC_3", "PC_10", "PC_11",
+    "USBTX", "USBRX"
+};
+
+int pinByName(const std::string& name) {
+    for (int i = 0; i < NUM_SIM_PINS; i++) {
+        if (name == pinNames[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void insert(Schedule& s, uint64_t due, Scheduled item) {
+    s.emplace(std::make_pair(due, insertSeq++), std::move(item));
+}
+
+void setDigital(int pin, int level) {
+    if (digitalPins[pin] == level) {
+        return;
+    }
+    digitalPins[pin] = level;
+    auto range = state().interruptPins.equal_range(pin);
+    for (auto it = range.first; it != range.second; ++it) {
+        it->second->edge(level);
+    }
+}
+
+// Backup registers survive the simulated power loss at the end of a run,
+// followed by a byte with the reason the run ended (the RCC reset flags)
+reset_reason_t lastResetReason = RESET_REASON_POWER_ON;
+
+void loadBackup() {
+    const char* path = getenv("WASHER_SIM_BACKUP");
+    FILE* f = path ? fopen(path, "rb") : nullptr;
+    if (f != nullptr) {
+        size_t n = fread((void*)&simRtc, 1, sizeof(simRtc), f);
+        uint8_t reason = RESET_REASON_POWER_ON;
+        n += fread(&reason, 1, 1, f);
+        lastResetReason = static_cast<reset_reason_t>(reason);
+        fclose(f);
+    }
+}
+
+[[noreturn]] void powerDown(reset_reason_t reason = RESET_REASON_POWER_ON) {
+    const char* path = getenv("WASHER_SIM_BACKUP");
+    FILE* f = path ? fopen(path, "wb") : nullptr;
+    if (f != nullptr) {
+        uint8_t byte = static_cast<uint8_t>(reason);
+        fwrite((const void*)&simRtc, 1, sizeof(simRtc), f);
+        fwrite(&byte, 1, 1, f);
+        fclose(f);
+    }
+    fflush(stdout);
+    _Exit(0);
+}
+
+void loadTrace() {
+    loadBackup();
+    for (int i = 0; i < NUM_SIM_PINS; i++) {
+        digitalPins[i] = 1;  // Buttons idle high
+    }
+    verbose = getenv("WASHER_SIM_VERBOSE") != nullptr;
+    const char* path = getenv("WASHER_SIM_TRACE");
+    if (path == nullptr) {
+        return;
+    }
+    FILE* f = fopen(path, "r");
+    if (f == nullptr) {
+        fprintf(stderr, "sim: cannot open trace %s\n", path);
+        exit(2);
+    }
+    char line[2048];   // Room for a SERIAL line carrying a hex upload
+    uint64_t last = 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        char signal[32];
+        double timeMs = 0;
+        double value = 0;
+        int fields = sscanf(line, "%lf,%31[^,\n],%lf", &timeMs, signal, &value);
+        if (fields < 2) {
+            continue;
+        }
+        uint64_t due = static_cast<uint64_t>(timeMs * 1000.0);
+        last = due > last ? due : last;
+        if (std::string(signal) == "END") {
+            endUs = due;
+            last = due;
+            continue;
+        }
+        if (std::string(signal) == "WOBBLE") {
+            float amplitude = static_cast<float>(value);
+            insert(state().timers, due, Scheduled{nullptr, 0, 0, [amplitude]() { wobbleAmplitude = amplitude; }});
+            endUs = last + 1000000;
+            continue;
+        }
+        if (std::string(signal) == "HANG") {
+            uint64_t until = due + static_cast<uint64_t>(value * 1000.0);
+            insert(state().timers, due, Scheduled{nullptr, 0, 0, [until]() { hangUntilUs = until; }});
+            endUs = last + 1000000;
+            continue;
+        }
+        if (std::string(signal) == "SERIAL") {
+            const char* text = strchr(strchr(line, ',') + 1, ',');
+            std::string input = text ? std::string(text + 1) : std::string("\n");
+            insert(state().timers, due, Scheduled{nullptr, 0, 0, [input]() { injectSerial(input); }});
+            endUs = last + 1000000;
+            continue;
+        }
+        int pin = pinByName(signal);
+        if (pin < 0) {
+            fprintf(stderr, "sim: unknown signal %s\n", signal);
+            exit(2);
+        }
+        float v = static_cast<float>(value);
+        insert(state().timers, due, Scheduled{nullptr, 0, 0, [pin, v]() {
+            analogPins[pin] = v;
+            setDigital(pin, v >= 0.5f ? 1 : 0);
+        }});
+        endUs = last + 1000000;
+    }
+    fclose(f);
+    const char* end = getenv("WASHER_SIM_END_MS");
+    if (end != nullptr) {
+        endUs = strtoull(end, nullptr, 10) * 1000;
+    }
+}
+
+struct TraceLoader {
+    TraceLoader() { loadTrace(); }
+} traceLoader;
+
+// Run the earliest item of a schedule, rescheduling periodic ones
+void runNext(Schedule& s) {
+    auto it = s.begin();
+    nowUs = it->first.first > nowUs ? it->first.first : nowUs;   // Later only for events held by a HANG
+    Scheduled item = std::move(it->second);
+    s.erase(it);
+    if (item.period_us != 0) {
+        insert(s, nowUs + item.period_us, item);
+    }
+    item.fn();
+}
+
+} // namespace
+
+namespace sim {
+
+uint64_t now_us() {
+    return nowUs;
+}
+
+void advance_us(uint64_t us) {
+    uint64_t target = nowUs + us;
+    while (!state().timers.empty() && state().timers.begin()->first.first <= target) {
+        runNext(state().timers);
+    }
+    nowUs = target;
+    if (nowUs >= endUs) {
+        powerDown();
+    }
+}
+
+float analog_value(PinName pin) {
+    if (pin != PA_1 || wobbleAmplitude == 0.0f) {
+        return analogPins[pin];
+    }
+    double rps = outputValues[PB_6] * SIM_MOTOR_MAX_RPM / 60.0;
+    drumAngle += 2.0 * M_PI * rps * (nowUs - drumAngleUs) / 1e6;
+    drumAngleUs = nowUs;
+    return analogPins[pin] + wobbleAmplitude * static_cast<float>(sin(drumAngle));
+}
+
+int digital_value(PinName pin) {
+    return digitalPins[pin];
+}
+
+void output_changed(PinName pin, const char* kind, float value) {
+    outputValues[pin] = value;
+    if (verbose) {
+        printf("[sim %8.3f s] %s %s=%g\n", nowUs / 1e6, pinNames[pin], kind, value);
+    }
+}
+
+void add_timer(void* owner, uint64_t due_us, std::function<void()> fn) {
+    insert(state().timers, due_us, Scheduled{owner, 0, 0, std::move(fn)});
+}
+
+void remove_timers(void* owner) {
+    for (Schedule* s : {&state().timers, &state().events}) {
+        for (auto it = s->begin(); it != s->end();) {
+            it = it->second.owner == owner ? s->erase(it) : std::next(it);
+        }
+    }
+}
+
+void run_forever() {
+    while (true) {
+        // A HANG holds thread events back, timers (ISRs) still fire
+        uint64_t eventDue = state().events.empty() ? endUs : state().events.begin()->first.first;
+        eventDue = eventDue < hangUntilUs ? hangUntilUs : eventDue;
+        bool timerFirst = !state().timers.empty() && state().timers.begin()->first.first <= eventDue;
+        uint64_t next = timerFirst ? state().timers.begin()->first.first : eventDue;
+        if (next >= endUs) {
+            nowUs = endUs;
+            powerDown();
+        }
+        runNext(timerFirst ? state().timers : state().events);
+    }
+}
+
+uint32_t app_rom_end() {
+    const char* kb = getenv("WASHER_SIM_IMAGE_KB");
+    return 0x08000000 + (kb ? (uint32_t)atoi(kb) : 100) * 1024;
+}
+
+} // namespace sim
+
+InterruptIn::InterruptIn(PinName pin) : DigitalIn(pin) {
+    state().interruptPins.emplace(pin, this);
+}
+
+InterruptIn::~InterruptIn() {
+    for (auto it = state().interruptPins.begin(); it != state().interruptPins.end(); ++it) {
+        if (it->second == this) {
+            state().interruptPins.erase(it);
+            break;
+        }
+    }
+}
+
+void InterruptIn::edge(int level) {
+    if (!_enabled) {
+        return;
+    }
+    if (level == 0 && _fall) {
+        _fall();
+    } else if (level == 1 && _rise) {
+        _rise();
+    }
+}
+
+namespace {
+std::string serialInput;
+BufferedSerial* serialPorts[4];
+}
+
+BufferedSerial::BufferedSerial(PinName, PinName, int) {
+    for (BufferedSerial*& p : serialPorts) {
+        if (p == nullptr) {
+            p = this;
+            break;
+        }
+    }
+}
+
+BufferedSerial::~BufferedSerial() {
+    for (BufferedSerial*& p : serialPorts) {
+        if (p == this) {
+            p = nullptr;
+        }
+    }
+}
+
+ssize_t BufferedSerial::read(void* buffer, size_t size) {
+    size_t n = size < serialInput.size() ? size : serialInput.size();
+    memcpy(buffer, serialInput.data(), n);
+    serialInput.erase(0, n);
+    return static_cast<ssize_t>(n);
+}
+
+bool BufferedSerial::readable() const {
+    return !serialInput.empty();
+}
+
+void injectSerial(const std::string& text) {
+    serialInput += text;
+    for (BufferedSerial* p : serialPorts) {
+        if (p != nullptr) {
+            p->notify();
+        }
+    }
+}
+
+namespace events {
+
+int EventQueue::post(uint64_t delay_us, uint64_t period_us, std::function<void()> fn) {
+    unsigned pending = 1;
+    for (const auto& e : state().events) {
+        pending += e.second.owner == this ? 1 : 0;
+    }
+    if (pending * EVENTS_EVENT_SIZE > _size) {
+        fprintf(stderr, "sim: event queue %p full (%u events), call dropped\n", (void*)this, pending - 1);
+        return 0;
+    }
+    if (_buffer != nullptr) {
+        memset(_buffer, 0, pending * EVENTS_EVENT_SIZE);
+    }
+    int id = nextEventId++;
+    insert(state().events, nowUs + delay_us, Scheduled{this, id, period_us, std::move(fn)});
+    return id;
+}
+
+bool EventQueue::cancel(int id) {
+    for (auto it = state().events.begin(); it != state().events.end(); ++it) {
+        if (it->second.owner == this && it->second.id == id) {
+            state().events.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace events
+
+namespace {
+// Mapped at the part's own flash address, so firmware that reads flash in
+// place through a pointer (memory-mapped flash on target) works unchanged
+uint8_t* flashImage = nullptr;
+
+void saveFlash() {
+    const char* path = getenv("WASHER_SIM_FLASH");
+    FILE* f = path ? fopen(path, "wb") : nullptr;
+    if (f != nullptr) {
+        fwrite(flashImage, 1, FlashIAP().get_flash_size(), f);
+        fclose(f);
+    }
+}
+
+bool flashRange(const FlashIAP& flash, uint32_t addr, uint32_t size) {
+    return addr >= flash.get_flash_start() && addr + size <= flash.get_flash_start() + flash.get_flash_size();
+}
+}
+
+int FlashIAP::init() {
+    if (flashImage == nullptr) {
+        void* want = reinterpret_cast<void*>(static_cast<uintptr_t>(get_flash_start()));
+        void* got = mmap(want, get_flash_size(), PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+        if (got != want) {
+            fprintf(stderr, "sim: cannot map flash at 0x%08x\n", (unsigned)get_flash_start());
+            exit(2);
+        }
+        flashImage = static_cast<uint8_t*>(got);
+        memset(flashImage, get_erase_value(), get_flash_size());
+        const char* path = getenv("WASHER_SIM_FLASH");
+        FILE* f = path ? fopen(path, "rb") : nullptr;
+        if (f != nullptr) {
+            size_t n = fread(flashImage, 1, get_flash_size(), f);
+            (void)n;
+            fclose(f);
+        }
+    }
+    return 0;
+}
+
+int FlashIAP::read(void* buffer, uint32_t addr, uint32_t size) {
+    if (!flashRange(*this, addr, size)) {
+        return -1;
+    }
+    memcpy(buffer, &flashImage[addr - get_flash_start()], size);
+    return 0;
+}
+
+int FlashIAP::program(const void* buffer, uint32_t addr, uint32_t size) {
+    if (!flashRange(*this, addr, size) || addr % get_page_size() || size % get_page_size()) {
+        return -1;
+    }
+    const uint8_t* bytes = static_cast<const uint8_t*>(buffer);
+    for (uint32_t i = 0; i < size; i++) {
+        flashImage[addr - get_flash_start() + i] &= bytes[i];
+    }
+    if (verbose) {
+        printf("[sim %8.3f s] flash program 0x%08x +%u\n", nowUs / 1e6, (unsigned)addr, (unsigned)size);
+    }
+    saveFlash();
+    return 0;
+}
+
+int FlashIAP::erase(uint32_t addr, uint32_t size) {
+    if (!flashRange(*this, addr, size) || addr % get_sector_size(addr)) {
+        return -1;
+    }
+    memset(&flashImage[addr - get_flash_start()], get_erase_value(), size);
+    if (verbose) {
+        printf("[sim %8.3f s] flash erase 0x%08x +%u\n", nowUs / 1e6, (unsigned)addr, (unsigned)size);
+    }
+    saveFlash();
+    // The caller stalls for the erase, about 1 s per 128 KB on the STM32F4
+    sim::advance_us((uint64_t)size * 1000000 / 0x20000);
+    return 0;
+}
+
+// 4 × 16 KB, 1 × 64 KB, then 128 KB sectors
+uint32_t FlashIAP::get_sector_size(uint32_t addr) const {
+    uint32_t offset = addr - get_flash_start();
+    if (offset < 0x10000) {
+        return 0x4000;
+    }
+    return offset < 0x20000 ? 0x10000 : 0x20000;
+}
+
+Watchdog& Watchdog::get_instance() {
+    static Watchdog watchdog;
+    return watchdog;
+}
+
+bool Watchdog::start(uint32_t timeout_ms) {
+    if (timeout_ms == 0 || timeout_ms > get_max_timeout()) {
+        return false;
+    }
+    _timeout_ms = timeout_ms;
+    _running = true;
+    kick();
+    return true;
+}
+
+// Each kick moves the reset out by the timeout
+void Watchdog::kick() {
+    if (!_running) {
+        return;
+    }
+    sim::remove_timers(this);
+    sim::add_timer(this, nowUs + _timeout_ms * 1000ull, []() {
+        printf("[sim %8.3f s] watchdog reset\n", nowUs / 1e6);
+        powerDown(RESET_REASON_WATCHDOG);
+    });
+}
+
+reset_reason_t ResetReason::get() {
+    return lastResetReason;
+}
+
+mbed::FileHandle* __attribute__((weak)) mbed::mbed_override_console(int) {
+    return nullptr;
+}
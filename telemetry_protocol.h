@@ -0,0 +1,121 @@
+// Wire format of the binary telemetry and command frames, shared by the
+// controller (main.cpp) and the host collector. Frames are SYNC, length,
+// payload, checksum (the byte sum of the frame is 0), little endian.
+// Codes are sent as numbers, so new values only ever go at the end.
+#ifndef WASHER_TELEMETRY_PROTOCOL_H
+#define WASHER_TELEMETRY_PROTOCOL_H
+
+#include <cstdint>
+
+// Telemetry frame types
+enum TelemetryType {
+    TLM_SETTINGS,   // values: rpm, temp set (°C), time (min)
+    TLM_SENSORS,    // values: load (‰), temp (0.1°C), light (0.1%), door open
+    TLM_EVENT,      // code: LogEvent, values: event arguments
+    TLM_STATUS,     // code: SystemState, values: phase, minutes left, program
+    TLM_REPLY,      // code: CommandCode, values: CommandStatus, count of frames sent
+    TLM_TIMING,     // TimingFrame
+    TLM_LOG_RECORD  // LogRecordFrame
+};
+
+// Command codes, the first payload byte of a binary command frame. The text
+// commands map onto the same codes.
+enum CommandCode {
+    CMD_PING = 0x01,          // Reply only
+    CMD_GET_SNAPSHOT = 0x02,  // Settings, sensors and status frames
+    CMD_START = 0x03,         // [program] Start the selected (or given) program
+    CMD_PAUSE = 0x04,
+    CMD_RESUME = 0x05,
+    CMD_STOP = 0x06,          // Cancel the running or paused cycle
+    CMD_SELECT = 0x07,        // program: select a program, 0 for the pots
+    CMD_GET_STATS = 0x08,     // Timing frames, then the reply
+    CMD_RESET_STATS = 0x09,
+    CMD_GET_LOG = 0x0A,       // [count] Cycle log records newest first, then the reply
+    CMD_SET_MODE = 0x0B,      // mode: 0 text telemetry, 1 binary frames
+    CMD_SET_ECO = 0x0C,       // on: eco heating from the next cycle, 0 off, 1 on
+    CMD_CALIBRATE = 0x0D      // [°C] Start calibrating in idle, or take the next step (°C on the temperature step, 0 keeps the gain)
+};
+
+// Command outcome, values[0] of a TLM_REPLY frame
+enum CommandStatus {
+    CMD_OK,
+    CMD_REFUSED,     // Not possible in the current state
+    CMD_UNKNOWN,     // No such command
+    CMD_BAD_ARGS,
+    CMD_BAD_FRAME,   // Length or checksum wrong, code is 0
+    CMD_DEFERRED,    // Reply follows the data it asked for
+    NUM_COMMAND_STATUSES
+};
+
+// Logged events, rendered from LOG_TEXT in text mode
+enum LogEvent {
+    LOG_BOOT,
+    LOG_POWER_ON,
+    LOG_POWER_OFF,
+    LOG_CYCLE_START,
+    LOG_PHASE,
+    LOG_COUNTDOWN,
+    LOG_CYCLE_COMPLETE,
+    LOG_ABORT_DOOR,
+    LOG_CYCLE_ENDED,
+    LOG_ALREADY_RUNNING,
+    LOG_START_DOOR_OPEN,
+    LOG_START_OVERLOAD,
+    LOG_OVERLOAD,
+    LOG_LOAD_OK,
+    LOG_CYCLE_PLAN,
+    LOG_RESUME_OFFER,
+    LOG_CYCLE_RESUMED,
+    LOG_CYCLE_CANCELLED,
+    LOG_CYCLE_PAUSED,
+    LOG_CYCLE_UNPAUSED,
+    LOG_RESUME_DOOR_OPEN,
+    LOG_HEAP_USED,
+    LOG_PROGRAM_SELECTED,
+    LOG_PROGRAM_MANUAL,
+    LOG_PROGRAMS_LOADED,
+    LOG_PROGRAMS_REJECTED,
+    LOG_PROGRAMS_BUSY,
+    LOG_PROGRAMS_WRITE_FAILED,
+    LOG_IMBALANCE,
+    LOG_SPIN_REDUCED,
+    LOG_HEAT_HOLD,
+    LOG_HEAT_DONE,
+    LOG_HEAT_TIMEOUT,
+    LOG_COMMAND_REFUSED,
+    LOG_CYCLE_ENERGY,
+    LOG_ECO_ON,
+    LOG_ECO_OFF,
+    LOG_CALIBRATE_CLOSED,
+    LOG_CALIBRATE_OPEN,
+    LOG_CALIBRATE_TEMP,
+    LOG_CALIBRATED,
+    LOG_CALIBRATION_DOOR_FAILED,
+    LOG_CALIBRATION_TEMP_FAILED,
+    LOG_CALIBRATION_CANCELLED,
+    LOG_CALIBRATION_NOT_SAVED,
+    LOG_CALIBRATION_LOADED,
+    LOG_FAULT,
+    LOG_ABORT_FAULT,
+    LOG_WATCHDOG_RESET,
+    LOG_FAULT_BEFORE_RESET,
+    LOG_WATCHDOG_UNEXPLAINED,
+    LOG_START_SAVING,
+    NUM_LOG_EVENTS
+};
+
+const uint8_t TELEMETRY_SYNC = 0xA5;      // Binary frame start byte (telemetry and commands)
+const int TELEMETRY_MAX_PAYLOAD = 64;     // Largest binary frame payload
+
+// Telemetry frame, sent as SYNC, length, frame bytes, checksum in binary mode
+struct TelemetryFrame {
+    uint8_t type;       // TelemetryType
+    uint8_t code;       // LogEvent, SystemState or CommandCode, by type
+    uint16_t seq;       // Frame sequence number, gaps mean dropped frames
+    uint32_t time_ms;   // Kernel clock when queued
+    int16_t values[4];  // Type specific values
+};
+
+static_assert(sizeof(TelemetryFrame) == 16, "TelemetryFrame must stay packed");
+
+#endif